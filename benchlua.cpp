@@ -0,0 +1,358 @@
+#include <chrono>
+
+#include <cstdlib>
+
+#include <iostream>
+
+#include <map>
+
+#include <numeric>
+
+#include <set>
+
+#include <string>
+
+#include <unordered_map>
+
+extern "C" {
+
+#include "lua/lualib.h"
+
+}
+
+#include "lualite/lualite.hpp"
+
+struct body
+{
+  double x_{}, y_{}, z_{};
+
+  double x() const { return x_; }
+  double y() const { return y_; }
+  double z() const { return z_; }
+
+  void set_x(double const v) { x_ = v; }
+  void set_y(double const v) { y_ = v; }
+  void set_z(double const v) { z_ = v; }
+};
+
+std::vector<double> numbers;
+
+// the conversions are called directly, so that both paths have the same
+// call overhead
+int block_push(lua_State* const L)
+{
+  return lualite::set(L, static_cast<std::vector<double> const&>(numbers));
+}
+
+template <typename T>
+int block_count(lua_State* const L)
+{
+  lua_pushinteger(L,
+    lua_Integer(lualite::get<1, std::vector<T>>(L).size()));
+
+  return 1;
+}
+
+// the element by element conversions of the generic paths, the baselines of
+// the block paths
+int generic_push(lua_State* const L)
+{
+  lua_createtable(L, lualite::size_hint(numbers.size()), 0);
+
+  int j{};
+
+  for (auto const v: numbers)
+  {
+    lualite::set(L, v);
+
+    lua_rawseti(L, -2, ++j);
+  }
+
+  return 1;
+}
+
+template <typename T>
+int generic_count(lua_State* const L)
+{
+  std::vector<T> result;
+
+  auto const cend(lua_rawlen(L, 1) + 1);
+
+  result.reserve(cend - 1);
+
+  for (decltype(lua_rawlen(L, 1)) i(1); i != cend; ++i)
+  {
+    lua_rawgeti(L, 1, i);
+
+    result.emplace_back(lualite::get<-1, T>(L));
+
+    lua_pop(L, 1);
+  }
+
+  lua_pushinteger(L, lua_Integer(result.size()));
+
+  return 1;
+}
+
+std::map<int, double> ordered_index;
+
+std::unordered_map<int, double> hashed_index;
+
+template <typename M, M& m>
+int push_index(lua_State* const L)
+{
+  return lualite::set(L, static_cast<M const&>(m));
+}
+
+template <typename M>
+int count_index(lua_State* const L)
+{
+  lua_pushinteger(L, lua_Integer(lualite::get<1, M>(L).size()));
+
+  return 1;
+}
+
+int count_names(lua_State* const L)
+{
+  lua_pushinteger(L,
+    lua_Integer(lualite::get<1, std::set<std::string>>(L).size()));
+
+  return 1;
+}
+
+// the conversions of maps and sets before they were key-type aware
+template <typename M, M& m>
+int generic_push_index(lua_State* const L)
+{
+  lua_createtable(L, 0, lualite::size_hint(m.size()));
+
+  for (auto& e: m)
+  {
+    lualite::set(L, e.first);
+    lualite::set(L, e.second);
+
+    lua_rawset(L, -3);
+  }
+
+  return 1;
+}
+
+template <typename M>
+int generic_count_index(lua_State* const L)
+{
+  M result;
+
+  lua_pushnil(L);
+
+  while (lua_next(L, 1))
+  {
+    result.emplace(lualite::get<-2, typename M::key_type>(L),
+      lualite::get<-1, typename M::mapped_type>(L)
+    );
+
+    lua_pop(L, 1);
+  }
+
+  lua_pushinteger(L, lua_Integer(result.size()));
+
+  return 1;
+}
+
+int generic_count_names(lua_State* const L)
+{
+  std::set<std::string> result;
+
+  auto const end(lua_rawlen(L, 1) + 1);
+
+  for (decltype(lua_rawlen(L, 1)) i(1); i != end; ++i)
+  {
+    lua_rawgeti(L, 1, i);
+
+    result.emplace(lualite::get<-1, std::string>(L));
+
+    lua_pop(L, 1);
+  }
+
+  lua_pushinteger(L, lua_Integer(result.size()));
+
+  return 1;
+}
+
+int make_plan(lua_State* const L)
+{
+  return lualite::set(L, lualite::accessor_plan<body>{"x", "y", "z"});
+}
+
+// runs the chunk and prints its run time
+void bench(lua_State* const L, char const* const name,
+  char const* const chunk)
+{
+  // the garbage of earlier runs is not charged to this one
+  lua_gc(L, LUA_GCCOLLECT, 0);
+
+  auto const start(std::chrono::steady_clock::now());
+
+  if (luaL_dostring(L, chunk))
+  {
+    std::cerr << name << ": " << lua_tostring(L, -1) << std::endl;
+
+    std::exit(EXIT_FAILURE);
+  }
+  // else do nothing
+
+  std::cout << name << ": " <<
+    std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start).count() << " ms" <<
+    std::endl;
+}
+
+int main()
+{
+  lua_State* const L(luaL_newstate());
+
+  luaL_openlibs(L);
+
+  lualite::module{L,
+    lualite::class_<body>("body")
+      .constructor()
+      .property<LLFUNC(body::x), LLFUNC(body::set_x)>("x")
+      .property<LLFUNC(body::y), LLFUNC(body::set_y)>("y")
+      .property<LLFUNC(body::z), LLFUNC(body::set_z)>("z")
+      .batch()
+      .array_constructor()
+  };
+
+  lua_register(L, "make_plan", make_plan);
+  lua_register(L, "block_push", block_push);
+  lua_register(L, "block_count_numbers", block_count<double>);
+  lua_register(L, "block_count_integers", block_count<int>);
+  lua_register(L, "generic_push", generic_push);
+  lua_register(L, "generic_count_numbers", generic_count<double>);
+  lua_register(L, "generic_count_integers", generic_count<int>);
+
+  using ordered = std::map<int, double>;
+  using hashed = std::unordered_map<int, double>;
+
+  lua_register(L, "push_ordered", (push_index<ordered, ordered_index>));
+  lua_register(L, "push_hashed", (push_index<hashed, hashed_index>));
+  lua_register(L, "count_ordered", count_index<ordered>);
+  lua_register(L, "count_hashed", count_index<hashed>);
+  lua_register(L, "count_names", count_names);
+  lua_register(L, "generic_push_ordered",
+    (generic_push_index<ordered, ordered_index>));
+  lua_register(L, "generic_push_hashed",
+    (generic_push_index<hashed, hashed_index>));
+  lua_register(L, "generic_count_ordered", generic_count_index<ordered>);
+  lua_register(L, "generic_count_hashed", generic_count_index<hashed>);
+  lua_register(L, "generic_count_names", generic_count_names);
+
+  luaL_dostring(L, "b = body.new() plan = make_plan() n = 1000000");
+
+  bench(L, "properties, get x, y, z",
+    "local b = b for i = 1, n do local x, y, z = b.x, b.y, b.z end");
+  bench(L, "batch, get x, y, z",
+    "local b = b for i = 1, n do local x, y, z = b:get(\"x\", \"y\", \"z\") end");
+  bench(L, "batch, set x, y, z",
+    "local b = b for i = 1, n do b:set{x = i, y = i, z = i} end");
+  bench(L, "plan, get x, y, z",
+    "local b, p = b, plan for i = 1, n do local x, y, z = p(b) end");
+  bench(L, "plan, set x, y, z",
+    "local b, p = b, plan for i = 1, n do p(b, i, i, i) end");
+
+  bench(L, "new(), 100k objects",
+    "local t = {} for i = 1, 100000 do t[i] = body.new() end");
+  bench(L, "new_array(), 100k objects",
+    "local ps = body.new_array(100000)");
+
+  luaL_dostring(L, "ps = body.new_array(100000)");
+
+  bench(L, "array, wrap elements and get x of 100k",
+    "local ps = ps for i = 1, #ps do local x = ps[i].x end");
+  bench(L, "array, get x of 100k wrapped elements",
+    "local ps = ps for i = 1, #ps do local x = ps[i].x end");
+  bench(L, "array, get(i, \"x\") of 100k elements",
+    "local ps = ps for i = 1, #ps do local x = ps:get(i, \"x\") end");
+  bench(L, "array, set(i, \"x\", i) of 100k elements",
+    "local ps = ps for i = 1, #ps do ps:set(i, \"x\", i) end");
+
+  // every size converts 10M elements in total
+  for (auto const size: {10, 1000, 100000, 10000000})
+  {
+    numbers.resize(size);
+    std::iota(numbers.begin(), numbers.end(), .5);
+
+    lua_pushinteger(L, size);
+    lua_setglobal(L, "size");
+
+    // the first run also grows the heap, so it is not timed
+    luaL_dostring(L, "t = {} for i = 1, size do t[i] = i end "
+      "calls = 10000000 // size "
+      "for i = 1, calls do local t = generic_push() end");
+
+    auto const of(" of " + std::to_string(size) + " elements");
+
+    bench(L, ("vector<double>, block push" + of).c_str(),
+      "for i = 1, calls do local t = block_push() end");
+    bench(L, ("vector<double>, generic push" + of).c_str(),
+      "for i = 1, calls do local t = generic_push() end");
+    bench(L, ("vector<double>, block read" + of).c_str(),
+      "local t = t for i = 1, calls do block_count_numbers(t) end");
+    bench(L, ("vector<double>, generic read" + of).c_str(),
+      "local t = t for i = 1, calls do generic_count_numbers(t) end");
+    bench(L, ("vector<int>, block read" + of).c_str(),
+      "local t = t for i = 1, calls do block_count_integers(t) end");
+    bench(L, ("vector<int>, generic read" + of).c_str(),
+      "local t = t for i = 1, calls do generic_count_integers(t) end");
+  }
+
+  // every size pushes 10M and reads 1M elements in total
+  for (auto const size: {10, 1000, 100000, 1000000})
+  {
+    ordered_index.clear();
+    hashed_index.clear();
+
+    for (int i{1}; i <= size; ++i)
+    {
+      ordered_index.emplace(i, i);
+      hashed_index.emplace(i, i);
+    }
+
+    lua_pushinteger(L, size);
+    lua_setglobal(L, "size");
+
+    // the first run also grows the heap, so it is not timed
+    luaL_dostring(L, "t = {} a = {} s = {} for i = 1, size do t[i] = i "
+      "a[i] = 'n' .. i s['n' .. i] = true end pushes = 10000000 // size "
+      "calls = 1000000 // size "
+      "for i = 1, pushes do local t = generic_push_hashed() end");
+
+    auto const of(" of " + std::to_string(size) + " elements");
+
+    bench(L, ("map<int, double>, push" + of).c_str(),
+      "for i = 1, pushes do local t = push_ordered() end");
+    bench(L, ("map<int, double>, generic push" + of).c_str(),
+      "for i = 1, pushes do local t = generic_push_ordered() end");
+    bench(L, ("unordered_map<int, double>, push" + of).c_str(),
+      "for i = 1, pushes do local t = push_hashed() end");
+    bench(L, ("unordered_map<int, double>, generic push" + of).c_str(),
+      "for i = 1, pushes do local t = generic_push_hashed() end");
+    bench(L, ("map<int, double>, read" + of).c_str(),
+      "local t = t for i = 1, calls do count_ordered(t) end");
+    bench(L, ("map<int, double>, generic read" + of).c_str(),
+      "local t = t for i = 1, calls do generic_count_ordered(t) end");
+    bench(L, ("unordered_map<int, double>, read" + of).c_str(),
+      "local t = t for i = 1, calls do count_hashed(t) end");
+    bench(L, ("unordered_map<int, double>, generic read" + of).c_str(),
+      "local t = t for i = 1, calls do generic_count_hashed(t) end");
+    bench(L, ("set<string>, read as array" + of).c_str(),
+      "local a = a for i = 1, calls do count_names(a) end");
+    bench(L, ("set<string>, generic read as array" + of).c_str(),
+      "local a = a for i = 1, calls do generic_count_names(a) end");
+    bench(L, ("set<string>, read as keys" + of).c_str(),
+      "local s = s for i = 1, calls do count_names(s) end");
+  }
+
+  lua_close(L);
+
+  return EXIT_SUCCESS;
+}
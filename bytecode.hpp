@@ -0,0 +1,417 @@
+/*
+** This is free and unencumbered software released into the public domain.
+
+** Anyone is free to copy, modify, publish, use, compile, sell, or
+** distribute this software, either in source code form or as a compiled
+** binary, for any purpose, commercial or non-commercial, and by any
+** means.
+
+** In jurisdictions that recognize copyright laws, the author or authors
+** of this software dedicate any and all copyright interest in the
+** software to the public domain. We make this dedication for the benefit
+** of the public at large and to the detriment of our heirs and
+** successors. We intend this dedication to be an overt act of
+** relinquishment in perpetuity of all present and future rights to this
+** software under copyright law.
+
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+** OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+** ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+** OTHER DEALINGS IN THE SOFTWARE.
+
+** For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef LUALITE_BYTECODE_HPP
+# define LUALITE_BYTECODE_HPP
+# pragma once
+
+#include <chrono>
+
+#include <cstdint>
+
+#include <cstdio>
+
+#include <cstdlib>
+
+#include <cstring>
+
+#include <functional>
+
+#include <string>
+
+#include <thread>
+
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif // __unix__ || __APPLE__
+
+#include "lualite.hpp"
+
+namespace lualite
+{
+
+namespace bytecode
+{
+
+// increment, whenever the layout of the cache files changes
+static constexpr std::uint32_t const format_version = 2;
+
+static constexpr char const magic[4]{'L', 'L', 'B', 'C'};
+
+// every cache file starts with the header, followed by the lua_dump of the
+// chunk, the body
+struct header
+{
+  char magic[4];
+
+  std::uint32_t version;
+
+  std::uint64_t key;
+
+  std::uint64_t source_size;
+
+  std::uint64_t body_hash;
+};
+
+// 64-bit FNV-1a
+inline std::uint64_t hash(void const* const data, std::size_t const size,
+  std::uint64_t h = 14695981039346656037ull) noexcept
+{
+  for (auto p(static_cast<unsigned char const*>(data)), e(p + size);
+    p != e; ++p)
+  {
+    h = (h ^ *p) * 1099511628211ull;
+  }
+
+  return h;
+}
+
+// identifies the lua build, bytecode is neither portable between lua
+// releases nor between builds with different number types
+inline std::uint64_t build_key() noexcept
+{
+  static auto const k([]() noexcept {
+      std::uint32_t const v[]{format_version, LUA_VERSION_NUM,
+        sizeof(void*), sizeof(lua_Integer), sizeof(lua_Number)};
+
+      return hash(LUA_RELEASE, std::strlen(LUA_RELEASE),
+        hash(v, sizeof(v)));
+    }()
+  );
+
+  return k;
+}
+
+// the bytes of a file, mapped into memory, where possible
+class file_view
+{
+  char const* data_{};
+
+  std::size_t size_{};
+
+#if defined(__unix__) || defined(__APPLE__)
+public:
+  explicit file_view(char const* const filename) noexcept
+  {
+    auto const fd(::open(filename, O_RDONLY));
+
+    if (-1 != fd)
+    {
+      struct ::stat st;
+
+      if (!::fstat(fd, &st))
+      {
+        if (st.st_size)
+        {
+          auto const p(::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE,
+            fd, 0));
+
+          if (MAP_FAILED != p)
+          {
+            data_ = static_cast<char const*>(p);
+            size_ = st.st_size;
+          }
+          // else do nothing
+        }
+        else
+        {
+          data_ = "";
+        }
+      }
+      // else do nothing
+
+      ::close(fd);
+    }
+    // else do nothing
+  }
+
+  ~file_view() noexcept
+  {
+    if (size_)
+    {
+      ::munmap(const_cast<char*>(data_), size_);
+    }
+    // else do nothing
+  }
+#else
+  std::vector<char> buffer_;
+
+public:
+  explicit file_view(char const* const filename)
+  {
+    if (auto const f = std::fopen(filename, "rb"))
+    {
+      char b[4096];
+
+      for (std::size_t n; (n = std::fread(b, 1, sizeof(b), f));)
+      {
+        buffer_.insert(buffer_.end(), b, b + n);
+      }
+
+      std::fclose(f);
+
+      data_ = buffer_.empty() ? "" : buffer_.data();
+      size_ = buffer_.size();
+    }
+    // else do nothing
+  }
+#endif // __unix__ || __APPLE__
+
+  file_view(file_view const&) = delete;
+
+  file_view& operator=(file_view const&) = delete;
+
+  auto data() const noexcept { return data_; }
+
+  auto size() const noexcept { return size_; }
+};
+
+}
+
+// loads chunks from lua_dumps of earlier compilations, that are kept in a
+// directory and named after a hash of the source, chunk name and lua build;
+// changed sources or a different lua thus never match a stale file. The
+// cache can be shared by many states and threads, files are written under
+// temporary names and then renamed. The directory must exist, if it is not
+// writable, chunks are simply compiled every time. A hash of the bytecode
+// catches damaged files, not forged ones: lua does not verify bytecode, so
+// whoever can write to the directory can run any code in the states using
+// it; the directory must be trusted.
+class bytecode_cache
+{
+  std::string const directory_;
+
+  bool const strip_;
+
+  static int writer(lua_State*, void const* const p, std::size_t const sz,
+    void* const ud)
+  {
+    auto& b(*static_cast<std::string*>(ud));
+
+    b.append(static_cast<char const*>(p), sz);
+
+    return 0;
+  }
+
+  std::string filename(std::uint64_t const key) const
+  {
+    char name[32];
+
+    std::snprintf(name, sizeof(name), "%016llx.luac",
+      static_cast<unsigned long long>(key));
+
+    return directory_.empty() ? name : directory_ + '/' + name;
+  }
+
+  // the temporary file is created exclusively, so that no two writers,
+  // in this or any other process, ever share one
+  static std::FILE* create_temporary(std::string& tmp) noexcept
+  {
+#if defined(__unix__) || defined(__APPLE__)
+    tmp.append(".XXXXXX");
+
+    auto const fd(::mkstemp(&tmp[0]));
+
+    if (-1 != fd)
+    {
+      if (auto const f = ::fdopen(fd, "wb"))
+      {
+        return f;
+      }
+      // else do nothing
+
+      ::close(fd);
+
+      std::remove(tmp.c_str());
+    }
+    // else do nothing
+
+    return {};
+#else
+    tmp.append('.' + std::to_string(
+      std::hash<std::thread::id>()(std::this_thread::get_id()) ^
+      std::chrono::steady_clock::now().time_since_epoch().count()));
+
+    return std::fopen(tmp.c_str(), "wbx");
+#endif // __unix__ || __APPLE__
+  }
+
+  // the cache is only an optimization, failures to write it are ignored
+  void store(std::string const& file, std::string const& b) const noexcept
+  {
+    auto tmp(file);
+
+    if (auto const f = create_temporary(tmp))
+    {
+      auto const ok(b.size() == std::fwrite(b.data(), 1, b.size(), f));
+
+      if (!std::fclose(f) && ok && !std::rename(tmp.c_str(), file.c_str()))
+      {
+        return;
+      }
+      // else do nothing
+
+      std::remove(tmp.c_str());
+    }
+    // else do nothing
+  }
+
+  [[noreturn]] static void raise(lua_State* const L)
+  {
+    error e(lua_tostring(L, -1));
+
+    lua_pop(L, 1);
+
+    throw e;
+  }
+
+public:
+  explicit bytecode_cache(std::string directory, bool const strip = false) :
+    directory_(std::move(directory)),
+    strip_(strip)
+  {
+  }
+
+  // pushes the chunk as a function; syntax errors are thrown as
+  // lualite::error. Stripped chunks lose their debug information, such as
+  // the line numbers in error messages.
+  void load(lua_State* const L, char const* const source,
+    std::size_t const size, char const* const name) const
+  {
+    auto const key(bytecode::hash(name, std::strlen(name) + 1,
+      bytecode::hash(source, size, bytecode::build_key() ^ strip_)));
+
+    auto const file(filename(key));
+
+    {
+      bytecode::file_view const v(file.c_str());
+
+      bytecode::header h;
+
+      if (v.size() > sizeof(h))
+      {
+        std::memcpy(&h, v.data(), sizeof(h));
+
+        if (!std::memcmp(h.magic, bytecode::magic, sizeof(h.magic)) &&
+          (bytecode::format_version == h.version) &&
+          (key == h.key) &&
+          (size == h.source_size) &&
+          (bytecode::hash(v.data() + sizeof(h), v.size() - sizeof(h)) ==
+            h.body_hash))
+        {
+          if (LUA_OK == luaL_loadbufferx(L, v.data() + sizeof(h),
+            v.size() - sizeof(h), name, "b"))
+          {
+            return;
+          }
+          // else do nothing
+
+          lua_pop(L, 1);
+        }
+        // else do nothing, a damaged file is replaced below
+      }
+      // else do nothing
+    }
+
+    if (LUA_OK != luaL_loadbufferx(L, source, size, name, "t"))
+    {
+      raise(L);
+    }
+    // else do nothing
+
+    bytecode::header h;
+
+    std::memcpy(h.magic, bytecode::magic, sizeof(h.magic));
+    h.version = bytecode::format_version;
+    h.key = key;
+    h.source_size = size;
+    h.body_hash = {};
+
+    std::string b(reinterpret_cast<char const*>(&h), sizeof(h));
+
+    if (!lua_dump(L, writer, &b, strip_))
+    {
+      h.body_hash = bytecode::hash(b.data() + sizeof(h), b.size() - sizeof(h));
+      std::memcpy(&b[0], &h, sizeof(h));
+
+      store(file, b);
+
+      // the chunk should not depend on whether it was cached
+      if (strip_)
+      {
+        lua_pop(L, 1);
+
+        if (LUA_OK != luaL_loadbufferx(L, b.data() + sizeof(h),
+          b.size() - sizeof(h), name, "b"))
+        {
+          raise(L);
+        }
+        // else do nothing
+      }
+      // else do nothing
+    }
+    // else do nothing
+  }
+
+  void load(lua_State* const L, std::string const& source,
+    char const* const name) const
+  {
+    load(L, source.data(), source.size(), name);
+  }
+
+  // the chunk is named "@filename", as luaL_loadfile() would name it
+  void load_file(lua_State* const L, char const* const filename) const
+  {
+    bytecode::file_view const v(filename);
+
+    if (!v.data())
+    {
+      throw error(std::string("cannot read ") + filename);
+    }
+    // else do nothing
+
+    load(L, v.data(), v.size(), (std::string(1, '@') + filename).c_str());
+  }
+
+  // loads and runs the chunk, as luaL_dostring() would
+  void run(lua_State* const L, char const* const source,
+    char const* const name) const
+  {
+    load(L, source, std::strlen(source), name);
+
+    pcall(L, LUA_MULTRET);
+  }
+};
+
+}
+
+#endif // LUALITE_BYTECODE_HPP
@@ -0,0 +1,301 @@
+/*
+** This is free and unencumbered software released into the public domain.
+
+** Anyone is free to copy, modify, publish, use, compile, sell, or
+** distribute this software, either in source code form or as a compiled
+** binary, for any purpose, commercial or non-commercial, and by any
+** means.
+
+** In jurisdictions that recognize copyright laws, the author or authors
+** of this software dedicate any and all copyright interest in the
+** software to the public domain. We make this dedication for the benefit
+** of the public at large and to the detriment of our heirs and
+** successors. We intend this dedication to be an overt act of
+** relinquishment in perpetuity of all present and future rights to this
+** software under copyright law.
+
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+** OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+** ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+** OTHER DEALINGS IN THE SOFTWARE.
+
+** For more information, please refer to <http://unlicense.org/>
+*/
+
+
+#ifndef LUALITE_CHANNEL_HPP
+# define LUALITE_CHANNEL_HPP
+# pragma once
+
+#include <algorithm>
+
+#include <atomic>
+
+#include <cstdint>
+
+#include <memory>
+
+#include <mutex>
+
+#include <string>
+
+#include <unordered_map>
+
+#include <vector>
+
+#include "lualite.hpp"
+
+namespace lualite
+{
+
+// a bounded lock-free queue of values, any number of threads may send and
+// receive, batches are claimed with a single compare and swap
+class channel
+{
+  struct cell
+  {
+    std::atomic<std::size_t> seq;
+
+    value v;
+  };
+
+  std::size_t const mask_;
+
+  std::unique_ptr<cell[]> const cells_;
+
+  alignas(64) std::atomic<std::size_t> head_{};
+
+  alignas(64) std::atomic<std::size_t> tail_{};
+
+  static auto round_up(std::size_t const n) noexcept
+  {
+    std::size_t r(2);
+
+    while (r < n)
+    {
+      r <<= 1;
+    }
+
+    return r;
+  }
+
+  // claims up to n consecutive cells, whose seq equals their position plus
+  // d, returns the first position and the number of cells claimed
+  auto claim(std::atomic<std::size_t>& p, std::size_t const d,
+    std::size_t const n) noexcept
+  {
+    auto pos(p.load(std::memory_order_relaxed));
+
+    for (;;)
+    {
+      std::size_t k{};
+
+      std::intptr_t diff{};
+
+      for (; k != n; ++k)
+      {
+        diff = std::intptr_t(
+          cells_[(pos + k) & mask_].seq.load(std::memory_order_acquire) -
+          (pos + k + d)
+        );
+
+        if (diff)
+        {
+          break;
+        }
+        // else do nothing
+      }
+
+      if (k)
+      {
+        if (p.compare_exchange_weak(pos, pos + k, std::memory_order_relaxed))
+        {
+          return std::make_pair(pos, k);
+        }
+        // else do nothing
+      }
+      else if (diff < 0)
+      {
+        // full or empty
+        return std::make_pair(pos, k);
+      }
+      else
+      {
+        pos = p.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  struct registry
+  {
+    std::mutex m;
+
+    std::unordered_map<std::string, std::shared_ptr<channel> > channels;
+  };
+
+  static auto& get_registry()
+  {
+    static registry r;
+
+    return r;
+  }
+
+public:
+  // the capacity is rounded up to a power of 2
+  explicit channel(std::size_t const capacity) :
+    mask_(round_up(capacity) - 1),
+    cells_(new cell[mask_ + 1])
+  {
+    for (std::size_t i{}; i <= mask_; ++i)
+    {
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  channel(channel const&) = delete;
+
+  channel& operator=(channel const&) = delete;
+
+  // returns the channel called name, creating it, if there is none
+  static std::shared_ptr<channel> open(char const* const name,
+    std::size_t const capacity)
+  {
+    auto& r(get_registry());
+
+    std::lock_guard<std::mutex> l(r.m);
+
+    auto& c(r.channels[name]);
+
+    if (!c)
+    {
+      c = std::make_shared<channel>(capacity);
+    }
+    // else do nothing
+
+    return c;
+  }
+
+  // the channel lives on as long as someone refers to it
+  static void close(char const* const name)
+  {
+    auto& r(get_registry());
+
+    std::lock_guard<std::mutex> l(r.m);
+
+    r.channels.erase(name);
+  }
+
+  auto capacity() const noexcept { return mask_ + 1; }
+
+  // moves up to n values, starting at i, into the channel, returns the
+  // number of values sent
+  template <typename It>
+  std::size_t send(It i, std::size_t const n)
+  {
+    auto const c(claim(head_, 0, n));
+
+    for (std::size_t j{}; j != c.second; ++j, ++i)
+    {
+      auto const pos(c.first + j);
+
+      auto& e(cells_[pos & mask_]);
+
+      e.v = std::move(*i);
+      e.seq.store(pos + 1, std::memory_order_release);
+    }
+
+    return c.second;
+  }
+
+  // moves up to n values into the range starting at o, returns the number
+  // of values received
+  template <typename It>
+  std::size_t recv(It o, std::size_t const n)
+  {
+    auto const c(claim(tail_, 1, n));
+
+    for (std::size_t j{}; j != c.second; ++j, ++o)
+    {
+      auto const pos(c.first + j);
+
+      auto& e(cells_[pos & mask_]);
+
+      *o = std::move(e.v);
+      e.v = {};
+      e.seq.store(pos + mask_ + 1, std::memory_order_release);
+    }
+
+    return c.second;
+  }
+
+  bool send(value v) { return send(&v, 1); }
+
+  bool recv(value& v) { return recv(&v, 1); }
+};
+
+// a channel, as seen from lua
+class channel_ref
+{
+  std::shared_ptr<channel> const c_;
+
+public:
+  channel_ref(char const* const name, std::size_t const capacity) :
+    c_(channel::open(name, capacity))
+  {
+  }
+
+  auto capacity() const noexcept { return c_->capacity(); }
+
+  // false, if the channel is full
+  bool send(value v) { return c_->send(std::move(v)); }
+
+  // nil, if the channel is empty
+  value recv()
+  {
+    value v;
+
+    c_->recv(v);
+
+    return v;
+  }
+
+  // sends a prefix of the array, returns its length
+  std::size_t send_many(std::vector<value> v)
+  {
+    return c_->send(v.begin(), v.size());
+  }
+
+  // returns an array of at most n values
+  std::vector<value> recv_many(std::size_t const n)
+  {
+    std::vector<value> r(std::min(n, c_->capacity()));
+
+    r.resize(c_->recv(r.begin(), r.size()));
+
+    return r;
+  }
+};
+
+// binds channel_ref, channel.new(name, capacity) opens a channel
+class channel_class : public class_<channel_ref>
+{
+public:
+  explicit channel_class(char const* const name = "channel") :
+    class_<channel_ref>(name)
+  {
+    constructor<char const*, std::size_t>();
+
+    def<LLFUNC(channel_ref::capacity)>("capacity");
+    def<LLFUNC(channel_ref::send)>("send");
+    def<LLFUNC(channel_ref::recv)>("recv");
+    def<LLFUNC(channel_ref::send_many)>("send_many");
+    def<LLFUNC(channel_ref::recv_many)>("recv_many");
+  }
+};
+
+}
+
+#endif // LUALITE_CHANNEL_HPP
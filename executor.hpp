@@ -0,0 +1,393 @@
+/*
+** This is free and unencumbered software released into the public domain.
+
+** Anyone is free to copy, modify, publish, use, compile, sell, or
+** distribute this software, either in source code form or as a compiled
+** binary, for any purpose, commercial or non-commercial, and by any
+** means.
+
+** In jurisdictions that recognize copyright laws, the author or authors
+** of this software dedicate any and all copyright interest in the
+** software to the public domain. We make this dedication for the benefit
+** of the public at large and to the detriment of our heirs and
+** successors. We intend this dedication to be an overt act of
+** relinquishment in perpetuity of all present and future rights to this
+** software under copyright law.
+
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+** OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+** ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+** OTHER DEALINGS IN THE SOFTWARE.
+
+** For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef LUALITE_EXECUTOR_HPP
+# define LUALITE_EXECUTOR_HPP
+# pragma once
+
+#include <atomic>
+
+#include <condition_variable>
+
+#include <deque>
+
+#include <exception>
+
+#include <functional>
+
+#include <future>
+
+#include <memory>
+
+#include <mutex>
+
+#include <string>
+
+#include <thread>
+
+#include <tuple>
+
+#include <vector>
+
+#include "lualite.hpp"
+
+namespace lualite
+{
+
+// runs calls of global lua functions on a pool of worker threads, each
+// worker owns a lua state, prepared by init, and a deque of tasks; idle
+// workers steal tasks from the others
+class executor
+{
+  struct task
+  {
+    virtual ~task() = default;
+
+    virtual void run(lua_State*) = 0;
+  };
+
+  // the arguments are copied once, into a tuple of C++ values, that set()
+  // pushes into whichever state runs the task; they are not captured as a
+  // state-neutral value, unless they are passed as one
+  template <typename R, typename ...A>
+  class call_task final : public task
+  {
+    std::string const name_;
+
+    std::tuple<A...> const args_;
+
+    std::promise<R> promise_;
+
+    template <std::size_t ...I>
+    void call(lua_State* const L, std::index_sequence<I...> const,
+      std::true_type const)
+    {
+      pcall_result<void>(L, std::get<I>(args_)...);
+
+      promise_.set_value();
+    }
+
+    template <std::size_t ...I>
+    void call(lua_State* const L, std::index_sequence<I...> const,
+      std::false_type const)
+    {
+      promise_.set_value(pcall_result<R>(L, std::get<I>(args_)...));
+    }
+
+  public:
+    template <typename ...B>
+    call_task(char const* const name, B&& ...args) :
+      name_(name),
+      args_(std::forward<B>(args)...)
+    {
+    }
+
+    auto get_future() { return promise_.get_future(); }
+
+    void run(lua_State* const L) final
+    {
+      try
+      {
+        lua_getglobal(L, name_.c_str());
+
+        call(L, std::index_sequence_for<A...>(), std::is_void<R>());
+      }
+      catch (...)
+      {
+        promise_.set_exception(std::current_exception());
+      }
+
+      lua_settop(L, 0);
+    }
+  };
+
+  struct worker
+  {
+    std::mutex m;
+
+    std::deque<std::unique_ptr<task> > tasks;
+
+    std::thread thread;
+  };
+
+  std::function<void(lua_State*)> const init_;
+
+  std::vector<std::unique_ptr<worker> > workers_;
+
+  std::mutex m_;
+  std::condition_variable cv_;
+
+  // queued, not yet taken tasks
+  std::atomic<std::size_t> pending_{};
+
+  std::atomic<std::size_t> next_{};
+
+  std::size_t initialized_{};
+
+  // thrown by an init, rethrown by the constructor
+  std::exception_ptr error_;
+
+  bool stop_{};
+
+  // the executor and worker the calling thread belongs to
+  static auto& current() noexcept
+  {
+    thread_local std::pair<executor const*, std::size_t> c;
+
+    return c;
+  }
+
+  void push(std::unique_ptr<task> t)
+  {
+    auto const& c(current());
+
+    auto& w(*workers_[this == c.first ?
+      c.second :
+      next_++ % workers_.size()]);
+
+    // counted before it is published, so pop() never sees it uncounted
+    {
+      std::lock_guard<std::mutex> l(m_);
+
+      ++pending_;
+    }
+
+    try
+    {
+      std::lock_guard<std::mutex> l(w.m);
+
+      w.tasks.push_back(std::move(t));
+    }
+    catch (...)
+    {
+      --pending_;
+
+      throw;
+    }
+
+    cv_.notify_one();
+  }
+
+  // own tasks are taken newest first, stolen ones oldest first
+  std::unique_ptr<task> pop(std::size_t const i)
+  {
+    std::unique_ptr<task> t;
+
+    auto const n(workers_.size());
+
+    for (std::size_t j{}; !t && (j != n); ++j)
+    {
+      auto& w(*workers_[(i + j) % n]);
+
+      std::lock_guard<std::mutex> l(w.m);
+
+      if (!w.tasks.empty())
+      {
+        if (j)
+        {
+          t = std::move(w.tasks.front());
+          w.tasks.pop_front();
+        }
+        else
+        {
+          t = std::move(w.tasks.back());
+          w.tasks.pop_back();
+        }
+
+        --pending_;
+      }
+      // else do nothing
+    }
+
+    return t;
+  }
+
+  void work(std::size_t const i)
+  {
+    current() = {this, i};
+
+    auto const L(luaL_newstate());
+
+    luaL_openlibs(L);
+
+    // the first init describes the classes, in the static members of
+    // class_, the other inits repeat the descriptions, which only reads them
+    bool done;
+
+    {
+      std::unique_lock<std::mutex> l(m_);
+
+      cv_.wait(l, [this, i]() noexcept { return !i || initialized_; });
+
+      done = bool(error_);
+    }
+
+    if (init_ && !done)
+    {
+      try
+      {
+        init_(L);
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> l(m_);
+
+        if (!error_)
+        {
+          error_ = std::current_exception();
+        }
+        // else do nothing
+      }
+    }
+    // else do nothing
+
+    lua_settop(L, 0);
+
+    // no task runs, while bindings are being registered
+    {
+      std::unique_lock<std::mutex> l(m_);
+
+      ++initialized_;
+
+      cv_.notify_all();
+
+      cv_.wait(l, [this]() noexcept {
+          return workers_.size() == initialized_;
+        }
+      );
+
+      // no task runs, if an init failed
+      done = bool(error_);
+    }
+
+    while (!done)
+    {
+      if (auto const t = pop(i))
+      {
+        t->run(L);
+      }
+      else
+      {
+        std::unique_lock<std::mutex> l(m_);
+
+        cv_.wait(l, [this]() noexcept { return stop_ || pending_; });
+
+        done = stop_ && !pending_;
+      }
+    }
+
+    lua_close(L);
+
+    current() = {};
+  }
+
+public:
+  // init is called in every worker with its fresh state, to apply the
+  // bindings and load the scripts; the first worker calls it before the
+  // others do, an exception thrown by any init is rethrown here
+  explicit executor(std::function<void(lua_State*)> init,
+    std::size_t n = std::thread::hardware_concurrency()) :
+    init_(std::move(init))
+  {
+    n = n ? n : 1;
+
+    workers_.reserve(n);
+
+    for (std::size_t i{}; i != n; ++i)
+    {
+      workers_.push_back(std::make_unique<worker>());
+    }
+
+    for (std::size_t i{}; i != n; ++i)
+    {
+      workers_[i]->thread = std::thread(&executor::work, this, i);
+    }
+
+    std::unique_lock<std::mutex> l(m_);
+
+    cv_.wait(l, [this]() noexcept {
+        return workers_.size() == initialized_;
+      }
+    );
+
+    if (error_)
+    {
+      l.unlock();
+
+      // the workers exit without running tasks
+      for (auto& w: workers_)
+      {
+        w->thread.join();
+      }
+
+      std::rethrow_exception(error_);
+    }
+    // else do nothing
+  }
+
+  executor(executor const&) = delete;
+
+  executor& operator=(executor const&) = delete;
+
+  // queued tasks are run before the workers exit
+  ~executor() noexcept
+  {
+    {
+      std::lock_guard<std::mutex> l(m_);
+
+      stop_ = true;
+    }
+
+    cv_.notify_all();
+
+    for (auto& w: workers_)
+    {
+      w->thread.join();
+    }
+  }
+
+  auto size() const noexcept { return workers_.size(); }
+
+  // calls the global function name with args in some worker's state, the
+  // result is converted with get<-1, R>()
+  template <typename R = void, typename ...A>
+  std::future<R> submit(char const* const name, A&& ...args)
+  {
+    auto t(std::make_unique<call_task<R, std::decay_t<A>...> >(name,
+      std::forward<A>(args)...));
+
+    auto f(t->get_future());
+
+    push(std::move(t));
+
+    return f;
+  }
+};
+
+}
+
+#endif // LUALITE_EXECUTOR_HPP
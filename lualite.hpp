@@ -33,37 +33,65 @@
 # error "You need a C++14 compiler to use lualite"
 #endif // __cplusplus
 
+#include <algorithm>
+
+#include <array>
+
+#include <atomic>
+
 #include <cassert>
 
+#include <cstdint>
+
 #include <cstring>
 
+#include <exception>
+
+#include <initializer_list>
+
+#include <iterator>
+
+#include <limits>
+
+#include <new>
+
+#include <stdexcept>
+
+#include <tuple>
+
 #include <type_traits>
 
 #include <unordered_map>
 
 #include <unordered_set>
 
+#include <utility>
+
 #include <vector>
 
 #ifndef LUALITE_NO_STD_CONTAINERS
 
-#include <array>
-
 #include <deque>
 
 #include <forward_list>
 
+#include <functional>
+
 #include <list>
 
 #include <map>
 
+#include <memory>
+
 #include <set>
 
 #include <string>
 
-#include <tuple>
+#if __cplusplus >= 201703L
+# include <memory_resource>
 
-#include <utility>
+# include <optional>
+#endif // __cplusplus
 
 #endif // LUALITE_NO_STD_CONTAINERS
 
@@ -86,6 +114,12 @@ class scope;
 
 template <class C> class class_;
 
+template <class C> struct descriptor;
+
+// classes opt into being described, next to specializing descriptor, see
+// described_class
+template <class C> struct is_described : std::false_type { };
+
 static constexpr auto const default_nrec = 10;
 
 namespace
@@ -105,6 +139,12 @@ using is_nc_reference =
     !std::is_const<std::remove_reference_t<T>>{}
   >;
 
+template <typename>
+struct is_const_member_function : std::false_type { };
+
+template <class R, class C, class ...A>
+struct is_const_member_function<R (C::*)(A...) const> : std::true_type { };
+
 struct swallow
 {
   template <typename ...T>
@@ -113,6 +153,12 @@ struct swallow
   }
 };
 
+template <bool ...B>
+using all_true = std::is_same<
+  std::integer_sequence<bool, true, B...>,
+  std::integer_sequence<bool, B..., true>
+>;
+
 // key is at the top of the stack
 inline void rawgetfield(lua_State* const L, int const index,
   char const* const key) noexcept
@@ -132,6 +178,12 @@ inline void rawsetfield(lua_State* const L, int const index,
   lua_rawset(L, i);
 }
 
+// lua_createtable() takes int size hints
+inline int size_hint(std::size_t const n) noexcept
+{
+  return int(std::min(n, std::size_t(std::numeric_limits<int>::max())));
+}
+
 constexpr inline auto hash(char const* s, std::size_t h = {}) noexcept
 {
   while (*s)
@@ -216,1149 +268,6063 @@ using map_member_info_type = lua_CFunction;
 
 using member_info_type = func_info_type;
 
-template <class C>
-int getter(lua_State* const L)
+using accessor_type = std::tuple<
+  std::vector<void* (*)(void*) noexcept>,
+  map_member_info_type,
+  enum property_type
+>;
+
+using accessors_type = std::unordered_map<char const*,
+  accessor_type,
+  str_hash,
+  str_eq
+>;
+
+// the names of stubs are kept in the registry, for profilers, see
+// profiler.hpp; stubs are only named, once the names were created, so that
+// states without a profiler pay nothing for them
+inline void const* stub_names_key() noexcept
 {
-  assert(2 == lua_gettop(L));
-  auto const i(lualite::class_<C>::getters().find(lua_tostring(L, 2)));
+  static char const k{};
 
-  if (lualite::class_<C>::getters().end() == i)
+  return &k;
+}
+
+// pushes the names of stubs, creating them, if need be
+inline void push_stub_names(lua_State* const L)
+{
+  if (LUA_TTABLE != lua_rawgetp(L, LUA_REGISTRYINDEX, stub_names_key()))
   {
-    return {};
+    lua_pop(L, 1);
+
+    lua_newtable(L);
+
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, stub_names_key());
   }
-  else
+  // else do nothing
+}
+
+class stub_names
+{
+  lua_State* const L_;
+
+  char const* const prefix_;
+
+  bool const named_;
+
+public:
+  stub_names(lua_State* const L, char const* const prefix) :
+    L_(L),
+    prefix_(prefix),
+    named_(LUA_TTABLE == lua_rawgetp(L, LUA_REGISTRYINDEX, stub_names_key()))
   {
-    auto const uvi(lua_upvalueindex(2));
+  }
 
-    void* p(lua_touserdata(L, uvi));
-    auto const q(p);
+  stub_names(stub_names const&) = delete;
 
-    for (auto const f: std::get<0>(i->second))
+  stub_names& operator=(stub_names const&) = delete;
+
+  ~stub_names() noexcept
+  {
+    lua_pop(L_, 1);
+  }
+
+  void add(lua_CFunction const f, char const* const name)
+  {
+    if (!named_)
     {
-      p = f(p);
+      return;
     }
+    // else do nothing
 
-    lua_pushlightuserdata(L, p);
-    lua_replace(L, uvi);
+    lua_pushcfunction(L_, f);
 
-    auto const se(
-      make_scope_exit(
-        [&]() noexcept {
-          lua_pushlightuserdata(L, q); lua_replace(L, uvi);
-        }
-      )
-    );
+    if (prefix_)
+    {
+      lua_pushfstring(L_, "%s.%s", prefix_, name);
+    }
+    else
+    {
+      lua_pushstring(L_, name);
+    }
 
-    return std::get<1>(i->second)(L);
+    lua_rawset(L_, -3);
   }
-}
 
-template <class C>
-int setter(lua_State* const L)
+  void add(func_info_type const& i)
+  {
+    add(i.callback, i.name);
+  }
+};
+
+struct described_constant_type
 {
-  assert(3 == lua_gettop(L));
-  auto const i(lualite::class_<C>::setters().find(lua_tostring(L, 2)));
+  char const* const name;
 
-  if (lualite::class_<C>::setters().end() != i)
-  {
-    auto const uvi(lua_upvalueindex(2));
+  enum property_type type;
+
+  lua_Integer integer;
+  lua_Number number;
+  char const* string;
+};
 
-    void* p(lua_touserdata(L, uvi));
-    auto const q(p);
+struct property_info_type
+{
+  char const* const name;
 
-    for (auto const f: std::get<0>(i->second))
-    {
-      p = f(p);
-    }
+  lua_CFunction const getter;
+  lua_CFunction const setter;
 
-    lua_pushlightuserdata(L, p);
-    lua_replace(L, uvi);
+  // the getter is a const member function, see shared
+  bool const const_getter;
+};
 
-    auto const se(make_scope_exit([&]() noexcept {
-      lua_pushlightuserdata(L, q); lua_replace(L, uvi);})
-    );
+// the entries of descriptors default to none
+struct descriptor_base
+{
+  static constexpr auto constructors() noexcept
+  {
+    return std::array<func_info_type, 0>{};
+  }
 
-    std::get<1>(i->second)(L);
+  static constexpr auto methods() noexcept
+  {
+    return std::array<member_info_type, 0>{};
   }
-  // else do nothing
 
-  return {};
+  static constexpr auto properties() noexcept
+  {
+    return std::array<property_info_type, 0>{};
+  }
+
+  static constexpr auto constants() noexcept
+  {
+    return std::array<described_constant_type, 0>{};
+  }
+};
+
+// the tables are constant initialized, no code runs at startup
+template <class C>
+inline auto const& described_constructors() noexcept
+{
+  static constexpr auto const v(descriptor<C>::constructors());
+
+  return v;
 }
 
 template <class C>
-inline void create_wrapper_table(lua_State* const L, C* const instance)
+inline auto const& described_methods() noexcept
 {
-  auto const uvi(lua_upvalueindex(1));
+  static constexpr auto const v(descriptor<C>::methods());
 
-  lua_pushvalue(L, uvi);
+  return v;
+}
 
-  if (lua_isnil(L, -1))
-  {
-    lua_createtable(L, 0, default_nrec);
+template <class C>
+inline auto const& described_properties() noexcept
+{
+  static constexpr auto const v(descriptor<C>::properties());
 
-    for (auto& mi: lualite::class_<C>::defs())
-    {
-      assert(lua_istable(L, -1));
+  return v;
+}
 
-      lua_pushnil(L);
+template <class C>
+inline auto const& described_constants() noexcept
+{
+  static constexpr auto const v(descriptor<C>::constants());
 
-      void* p(instance);
+  return v;
+}
 
-      for (auto const f: mi.first)
-      {
-        p = f(p);
-      }
+template <class C>
+inline std::enable_if_t<!is_described<C>{}>
+push_defs(lua_State* const L, C* const instance)
+{
+  for (auto& mi: lualite::class_<C>::defs())
+  {
+    assert(lua_istable(L, -1));
 
-      lua_pushlightuserdata(L, p);
-      lua_pushcclosure(L, mi.second.callback, 2);
+    void* p(instance);
 
-      rawsetfield(L, -2, mi.second.name);
+    for (auto const f: mi.first)
+    {
+      p = f(p);
     }
 
-    // metatable
-    assert(lua_istable(L, -1));
-    lua_createtable(L, 0, 2);
+    lua_pushnil(L);
+    lua_pushlightuserdata(L, p);
+    lua_pushcclosure(L, mi.second.callback, 2);
+
+    rawsetfield(L, -2, mi.second.name);
+  }
+}
 
-    // getters
+template <class C>
+inline std::enable_if_t<is_described<C>{}>
+push_defs(lua_State* const L, C* const instance)
+{
+  for (auto& mi: described_methods<C>())
+  {
     assert(lua_istable(L, -1));
 
     lua_pushnil(L);
     lua_pushlightuserdata(L, instance);
+    lua_pushcclosure(L, mi.callback, 2);
 
-    lua_pushcclosure(L, getter<C>, 2);
+    rawsetfield(L, -2, mi.name);
+  }
+}
 
-    rawsetfield(L, -2, "__index");
+// the properties, sorted by name, are built on first use, without
+// allocating
+template <class C>
+inline auto const& described_property_index() noexcept
+{
+  using properties_type = std::decay_t<decltype(described_properties<C>())>;
 
-    // setters
-    assert(lua_istable(L, -1));
+  using index_type = std::array<property_info_type const*,
+    std::tuple_size<properties_type>{}
+  >;
 
-    lua_pushnil(L);
-    lua_pushlightuserdata(L, instance);
+  static auto const v([]() noexcept {
+      index_type v;
 
-    lua_pushcclosure(L, setter<C>, 2);
+      auto const& p(described_properties<C>());
 
-    rawsetfield(L, -2, "__newindex");
+      std::transform(p.cbegin(), p.cend(), v.begin(),
+        [](auto& pi) noexcept { return &pi; });
 
-    lua_setmetatable(L, -2);
+      std::sort(v.begin(), v.end(),
+        [](auto const a, auto const b) noexcept {
+          return std::strcmp(a->name, b->name) < 0;
+        }
+      );
+
+      return v;
+    }()
+  );
 
-    lua_copy(L, -1, uvi);
+  return v;
+}
+
+template <class C>
+inline property_info_type const* find_property(char const* const name)
+  noexcept
+{
+  if (name)
+  {
+    auto const& v(described_property_index<C>());
+
+    auto const i(std::lower_bound(v.cbegin(), v.cend(), name,
+      [](auto const pi, char const* const name) noexcept {
+        return std::strcmp(pi->name, name) < 0;
+      }
+    ));
+
+    if ((v.cend() != i) && !std::strcmp((*i)->name, name))
+    {
+      return *i;
+    }
+    // else do nothing
   }
   // else do nothing
 
-  assert(lua_istable(L, uvi));
-  assert(lua_istable(L, -1));
+  return {};
 }
 
-template <typename T>
-inline std::enable_if_t<
-  std::is_floating_point<std::decay_t<T>>{} &&
-  !is_nc_reference<T>{},
-  int
->
-set(lua_State* const L, T&& v) noexcept
+// batches, plans and shared proxies call properties through accessors;
+// those of described classes need no pointer adjustment
+template <class C>
+inline auto const& described_accessors()
 {
-  lua_pushnumber(L, v);
+  using properties_type = std::decay_t<decltype(described_properties<C>())>;
 
-  return 1;
+  using accessors_type = std::array<std::pair<accessor_type, accessor_type>,
+    std::tuple_size<properties_type>{}
+  >;
+
+  static auto const v([]() {
+      accessors_type v;
+
+      auto const& p(described_properties<C>());
+
+      std::transform(p.cbegin(), p.cend(), v.begin(),
+        [](auto& pi) {
+          return std::make_pair(accessor_type({}, pi.getter, OTHER),
+            accessor_type({}, pi.setter, OTHER));
+        }
+      );
+
+      return v;
+    }()
+  );
+
+  return v;
 }
 
-template <typename T>
-inline std::enable_if_t<
-  std::is_integral<std::decay_t<T>>{} &&
-  !std::is_same<std::decay_t<T>, bool>{} &&
-  !is_nc_reference<T>{},
-  int
->
-set(lua_State* const L, T&& v) noexcept
+template <class C>
+inline std::enable_if_t<!is_described<C>{}, accessor_type const*>
+find_getter(char const* const name)
 {
-  lua_pushinteger(L, v);
+  auto const& g(lualite::class_<C>::getters());
 
-  return 1;
+  auto const i(g.find(name));
+
+  return g.end() == i ? nullptr : &i->second;
 }
 
-template <typename T>
-inline std::enable_if_t<
-  std::is_same<std::decay_t<T>, bool>{} &&
-  !is_nc_reference<T>{},
-  int
->
-set(lua_State* const L, T&& v) noexcept
+template <class C>
+inline std::enable_if_t<!is_described<C>{}, accessor_type const*>
+find_setter(char const* const name)
 {
-  lua_pushboolean(L, v);
+  auto const& s(lualite::class_<C>::setters());
 
-  return 1;
+  auto const i(s.find(name));
+
+  return s.end() == i ? nullptr : &i->second;
 }
 
-template <typename T>
-inline std::enable_if_t<
-  std::is_same<std::decay_t<T>, char const*>{} &&
-  !is_nc_reference<T>{},
-  int
->
-set(lua_State* const L, T&& v) noexcept
+template <class C>
+inline std::enable_if_t<!is_described<C>{}, accessor_type const*>
+find_const_getter(char const* const name)
 {
-  lua_pushstring(L, v);
+  auto const& g(lualite::class_<C>::const_getters());
 
-  return 1;
+  auto const i(g.find(name));
+
+  return g.end() == i ? nullptr : &i->second;
 }
 
-template <typename T>
-inline std::enable_if_t<
-  std::is_same<std::decay_t<T>, void const*>{} &&
-  !is_nc_reference<T>{},
-  int
->
-set(lua_State* const L, T&& v) noexcept
+template <class C>
+inline std::enable_if_t<is_described<C>{}, accessor_type const*>
+find_getter(char const* const name)
 {
-  lua_pushlightuserdata(L, const_cast<void*>(v));
+  auto const pi(find_property<C>(name));
 
-  return 1;
+  return pi && pi->getter ?
+    &described_accessors<C>()[pi - described_properties<C>().data()].first :
+    nullptr;
 }
 
-template <typename T>
-inline std::enable_if_t<
-  std::is_pointer<T>{} &&
-  !std::is_const<std::remove_pointer_t<T>>{} &&
-  !std::is_class<std::remove_pointer_t<T>>{},
-  int
->
-set(lua_State* const L, T&& v) noexcept
+template <class C>
+inline std::enable_if_t<is_described<C>{}, accessor_type const*>
+find_setter(char const* const name)
 {
-  lua_pushlightuserdata(L, v);
+  auto const pi(find_property<C>(name));
+
+  return pi && pi->setter ?
+    &described_accessors<C>()[pi - described_properties<C>().data()].second :
+    nullptr;
+}
+
+template <class C>
+inline std::enable_if_t<is_described<C>{}, accessor_type const*>
+find_const_getter(char const* const name)
+{
+  auto const pi(find_property<C>(name));
+
+  return pi && pi->const_getter ? find_getter<C>(name) : nullptr;
+}
+
+// batched property access; the property stubs are called directly, like
+// getter<C> calls them, with the adjusted object in upvalue 2 of the
+// running closure; they find the values they expect at indices 1 to 3 and
+// may find more values above those
+inline void prepare_accessor(lua_State* const L, accessor_type const& a,
+  void* p) noexcept
+{
+  for (auto const f: std::get<0>(a))
+  {
+    p = f(p);
+  }
+
+  lua_pushlightuserdata(L, p);
+  lua_replace(L, lua_upvalueindex(2));
+}
+
+// replaces the value at i by the first result of the getter
+inline void call_getter(lua_State* const L, accessor_type const& a,
+  void* const p, int const i)
+{
+  prepare_accessor(L, a, p);
+
+  auto const top(lua_gettop(L));
+
+  if (auto const r = std::get<1>(a)(L))
+  {
+    lua_copy(L, -r, i);
+  }
+  else
+  {
+    lua_pushnil(L);
+    lua_replace(L, i);
+  }
+
+  lua_settop(L, top);
+}
+
+template <class C>
+std::enable_if_t<is_described<C>{}, int> getter(lua_State* const L)
+{
+  assert(2 == lua_gettop(L));
+  auto const pi(find_property<C>(lua_tostring(L, 2)));
+
+  if (pi && pi->getter)
+  {
+    lua_pushvalue(L, lua_upvalueindex(3));
+    lua_replace(L, lua_upvalueindex(2));
+
+    return pi->getter(L);
+  }
+  else
+  {
+    return {};
+  }
+}
+
+template <class C>
+std::enable_if_t<is_described<C>{}, int> setter(lua_State* const L)
+{
+  assert(3 == lua_gettop(L));
+  auto const pi(find_property<C>(lua_tostring(L, 2)));
+
+  if (pi && pi->setter)
+  {
+    lua_pushvalue(L, lua_upvalueindex(3));
+    lua_replace(L, lua_upvalueindex(2));
+
+    pi->setter(L);
+  }
+  // else do nothing
+
+  return {};
+}
+
+template <class C>
+std::enable_if_t<!is_described<C>{}, int> getter(lua_State* const L)
+{
+  assert(2 == lua_gettop(L));
+  auto const i(lualite::class_<C>::getters().find(lua_tostring(L, 2)));
+
+  if (lualite::class_<C>::getters().end() == i)
+  {
+    return {};
+  }
+  else
+  {
+    // upvalue 3 holds the instance, upvalue 2 the adjusted pointer, the
+    // latter is rewritten on every access, as an error may leave it stale
+    void* p(lua_touserdata(L, lua_upvalueindex(3)));
+
+    for (auto const f: std::get<0>(i->second))
+    {
+      p = f(p);
+    }
+
+    lua_pushlightuserdata(L, p);
+    lua_replace(L, lua_upvalueindex(2));
+
+    return std::get<1>(i->second)(L);
+  }
+}
+
+template <class C>
+std::enable_if_t<!is_described<C>{}, int> setter(lua_State* const L)
+{
+  assert(3 == lua_gettop(L));
+  auto const i(lualite::class_<C>::setters().find(lua_tostring(L, 2)));
+
+  if (lualite::class_<C>::setters().end() != i)
+  {
+    void* p(lua_touserdata(L, lua_upvalueindex(3)));
+
+    for (auto const f: std::get<0>(i->second))
+    {
+      p = f(p);
+    }
+
+    lua_pushlightuserdata(L, p);
+    lua_replace(L, lua_upvalueindex(2));
+
+    std::get<1>(i->second)(L);
+  }
+  // else do nothing
+
+  return {};
+}
+
+template <class C>
+int wrap_stub(lua_State*);
+
+// pushes a new wrapper table of the instance, leaves its metatable, with
+// room for nrec fields, on top
+template <class C>
+inline void new_wrapper_table(lua_State* const L, C* const instance,
+  int const nrec = 3)
+{
+  lua_createtable(L, 0, default_nrec);
+
+  push_defs(L, instance);
+
+  // metatable
+  assert(lua_istable(L, -1));
+  lua_createtable(L, 0, nrec);
+
+  // wrap
+  assert(lua_istable(L, -1));
+
+  lua_pushnil(L);
+  lua_pushlightuserdata(L, instance);
+
+  lua_pushcclosure(L, wrap_stub<C>, 2);
+
+  rawsetfield(L, -2, "__wrap");
+
+  // getters
+  assert(lua_istable(L, -1));
+
+  lua_pushnil(L);
+  lua_pushlightuserdata(L, instance);
+  lua_pushlightuserdata(L, instance);
+
+  lua_pushcclosure(L, getter<C>, 3);
+
+  rawsetfield(L, -2, "__index");
+
+  // setters
+  assert(lua_istable(L, -1));
+
+  lua_pushnil(L);
+  lua_pushlightuserdata(L, instance);
+  lua_pushlightuserdata(L, instance);
+
+  lua_pushcclosure(L, setter<C>, 3);
+
+  rawsetfield(L, -2, "__newindex");
+}
+
+inline void track_wrapper(lua_State*, void const*) noexcept;
+
+template <class C>
+inline void create_wrapper_table(lua_State* const L, C* const instance)
+{
+  auto const uvi(lua_upvalueindex(1));
+
+  lua_pushvalue(L, uvi);
+
+  if (!lua_istable(L, -1))
+  {
+    // upvalue 1 caches the wrapper table, unless it holds something else,
+    // see batch_object
+    auto const cache(lua_isnil(L, -1));
+
+    new_wrapper_table(L, instance);
+
+    lua_setmetatable(L, -2);
+
+    track_wrapper(L, instance);
+
+    if (cache)
+    {
+      lua_copy(L, -1, uvi);
+    }
+    // else do nothing
+  }
+  // else do nothing
+
+  assert(lua_istable(L, -1));
+}
+
+// pushes a wrapper table of the instance in upvalue 2, lets other states
+// refer to an object, see value
+template <class C>
+int wrap_stub(lua_State* const L)
+{
+  create_wrapper_table(L,
+    static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2))));
 
   return 1;
 }
 
 template <typename T>
 inline std::enable_if_t<
-  is_nc_reference<T>{} &&
-  !std::is_class<std::decay_t<T>>{},
+  std::is_floating_point<std::decay_t<T>>{} &&
+  !is_nc_reference<T>{},
   int
 >
 set(lua_State* const L, T&& v) noexcept
 {
-  lua_pushlightuserdata(L, &v);
+  lua_pushnumber(L, v);
 
   return 1;
 }
 
 template <typename T>
 inline std::enable_if_t<
-  std::is_pointer<std::decay_t<T>>{} &&
-  !std::is_const<std::remove_pointer_t<T>>{} &&
-  std::is_class<std::remove_pointer_t<std::decay_t<T>>>{},
+  std::is_integral<std::decay_t<T>>{} &&
+  !std::is_same<std::decay_t<T>, bool>{} &&
+  !is_nc_reference<T>{},
   int
 >
 set(lua_State* const L, T&& v) noexcept
 {
-  create_wrapper_table(L, v);
+  lua_pushinteger(L, v);
 
   return 1;
 }
 
 template <typename T>
 inline std::enable_if_t<
-  is_nc_reference<T>{} &&
-  std::is_class<std::decay_t<T>>{},
+  std::is_same<std::decay_t<T>, bool>{} &&
+  !is_nc_reference<T>{},
   int
 >
 set(lua_State* const L, T&& v) noexcept
 {
-  create_wrapper_table(L, &v);
+  lua_pushboolean(L, v);
 
   return 1;
 }
 
 template <typename T>
 inline std::enable_if_t<
-  std::is_same<std::decay_t<T>, any>{} &&
+  std::is_same<std::decay_t<T>, char const*>{} &&
   !is_nc_reference<T>{},
   int
 >
-set(lua_State* const, T&&) noexcept
+set(lua_State* const L, T&& v) noexcept
 {
+  lua_pushstring(L, v);
+
   return 1;
 }
 
-template <int I, typename T>
+template <typename T>
 inline std::enable_if_t<
-  std::is_floating_point<std::decay_t<T>>{} &&
+  std::is_same<std::decay_t<T>, void const*>{} &&
   !is_nc_reference<T>{},
-  std::decay_t<T>
+  int
 >
-get(lua_State* const L) noexcept
+set(lua_State* const L, T&& v) noexcept
 {
-  assert(lua_isnumber(L, I));
-  return lua_tonumber(L, I);
+  lua_pushlightuserdata(L, const_cast<void*>(v));
+
+  return 1;
 }
 
-template <int I, typename T>
+template <typename T>
 inline std::enable_if_t<
-  std::is_integral<std::decay_t<T>>{} &&
-  !std::is_same<std::decay_t<T>, bool>{} &&
-  !is_nc_reference<T>{},
-  std::decay_t<T>
+  std::is_pointer<T>{} &&
+  !std::is_const<std::remove_pointer_t<T>>{} &&
+  !std::is_class<std::remove_pointer_t<T>>{},
+  int
 >
-get(lua_State* const L) noexcept
+set(lua_State* const L, T&& v) noexcept
 {
-  assert(lua_isnumber(L, I));
-  return lua_tointeger(L, I);
+  lua_pushlightuserdata(L, v);
+
+  return 1;
 }
 
-template <int I, typename T>
+template <typename T>
 inline std::enable_if_t<
-  std::is_same<std::decay_t<T>, bool>{} &&
-  !is_nc_reference<T>{},
-  std::decay_t<T>
+  is_nc_reference<T>{} &&
+  !std::is_class<std::decay_t<T>>{},
+  int
 >
-get(lua_State* const L) noexcept
+set(lua_State* const L, T&& v) noexcept
 {
-  assert(lua_isboolean(L, I));
-  return lua_toboolean(L, I);
+  lua_pushlightuserdata(L, &v);
+
+  return 1;
 }
 
-template <int I, typename T>
+template <typename T>
 inline std::enable_if_t<
-  std::is_same<std::decay_t<T>, char const*>{} &&
-  !is_nc_reference<T>{},
-  std::decay_t<T>
+  std::is_pointer<std::decay_t<T>>{} &&
+  !std::is_const<std::remove_pointer_t<T>>{} &&
+  std::is_class<std::remove_pointer_t<std::decay_t<T>>>{},
+  int
 >
-get(lua_State* const L) noexcept
+set(lua_State* const L, T&& v) noexcept
 {
-  assert(lua_isstring(L, I));
-  return lua_tostring(L, I);
+  create_wrapper_table(L, v);
+
+  return 1;
 }
 
-template <int I, typename T>
+template <typename T>
 inline std::enable_if_t<
-  std::is_pointer<T>{} &&
-  !std::is_same<std::decay_t<T>, char const*>{},
-  std::decay_t<T>
+  is_nc_reference<T>{} &&
+  std::is_class<std::decay_t<T>>{},
+  int
 >
-get(lua_State* const L) noexcept
+set(lua_State* const L, T&& v) noexcept
 {
-  assert(lua_islightuserdata(L, I));
-  return static_cast<T>(lua_touserdata(L, I));
-}
+  create_wrapper_table(L, &v);
 
-template <int I, typename T>
-inline std::enable_if_t<
-  is_nc_reference<T>{},
-  T
->
-get(lua_State* const L) noexcept
-{
-  assert(lua_islightuserdata(L, I));
-  return *static_cast<std::decay_t<T>*>(lua_touserdata(L, I));
+  return 1;
 }
 
-template <int I, typename T>
-inline std::enable_if_t<
-  std::is_same<std::remove_const_t<T>, any>{},
-  T
->
-get(lua_State* const) noexcept
+struct handle_slot
 {
-  return {};
-}
+  void* p;
 
-#ifndef LUALITE_NO_STD_CONTAINERS
+  std::uint32_t generation;
 
-template <typename>
-struct is_std_pair : std::false_type { };
+  handle_slot* next;
+};
 
-template <class T1, class T2>
-struct is_std_pair<std::pair<T1, T2> > : std::true_type { };
+// a weak reference to an object owned by C++; attach() gives the object a
+// slot, detach() increments the generation of the slot, which invalidates
+// all copies of the handle, in C++ and in lua, and recycles the slot. The
+// slots of a class are not synchronized, attach and detach its handles on
+// the threads running the states, or synchronize with them.
+template <class C>
+class weak_handle
+{
+  static constexpr std::size_t const chunk_size = 256;
 
-template <typename>
-struct is_std_array : std::false_type { };
+  handle_slot* s_{};
 
-template <typename T, std::size_t N>
-struct is_std_array<std::array<T, N> > : std::true_type { };
+  std::uint32_t generation_{};
 
-template <typename>
-struct is_std_deque : std::false_type { };
+  static auto& free_slots() noexcept
+  {
+    static handle_slot* s;
 
-template <typename T, class Alloc>
-struct is_std_deque<std::deque<T, Alloc> > : std::true_type { };
+    return s;
+  }
 
-template <typename>
-struct is_std_forward_list : std::false_type { };
+public:
+  weak_handle() = default;
 
-template <typename T, class Alloc>
-struct is_std_forward_list<std::forward_list<T, Alloc> > : std::true_type { };
+  weak_handle(handle_slot* const s, std::uint32_t const generation) noexcept :
+    s_(s),
+    generation_(generation)
+  {
+  }
 
-template <typename>
-struct is_std_list : std::false_type { };
+  static weak_handle attach(C* const p)
+  {
+    auto& f(free_slots());
 
-template <typename T, class Alloc>
-struct is_std_list<std::list<T, Alloc> > : std::true_type { };
+    if (!f)
+    {
+      // slots are never freed, handles may outlive any state
+      static std::vector<std::vector<handle_slot> > chunks;
 
-template <typename>
-struct is_std_map : std::false_type { };
+      chunks.push_back(std::vector<handle_slot>(chunk_size));
 
-template <class Key, class T, class Compare, class Alloc>
-struct is_std_map<std::map<Key, T, Compare, Alloc> > : std::true_type { };
+      for (auto& s: chunks.back())
+      {
+        s.next = f;
+        f = &s;
+      }
+    }
+    // else do nothing
 
-template <typename>
-struct is_std_set : std::false_type { };
+    auto const s(f);
+    f = s->next;
 
-template <class Key, class Compare, class Alloc>
-struct is_std_set<std::set<Key, Compare, Alloc> > : std::true_type { };
+    s->p = p;
 
-template <typename>
-struct is_std_unordered_map : std::false_type { };
+    return {s, s->generation};
+  }
 
-template <class Key, class T, class Hash, class P, class Alloc>
-struct is_std_unordered_map<std::unordered_map<Key, T, Hash, P, Alloc> > :
-  std::true_type { };
+  void detach() const noexcept
+  {
+    if (*this)
+    {
+      s_->p = {};
 
-template <typename>
-struct is_std_unordered_set : std::false_type { };
+      // slots, whose generation wraps around, are retired
+      if (++s_->generation)
+      {
+        auto& f(free_slots());
 
-template <class Key, class Hash, class Equal, class Alloc>
-struct is_std_unordered_set<std::unordered_set<Key, Hash, Equal, Alloc> > :
-  std::true_type { };
+        s_->next = f;
+        f = s_;
+      }
+      // else do nothing
+    }
+    // else do nothing
+  }
 
-template <typename>
-struct is_std_tuple : std::false_type { };
+  C* get() const noexcept
+  {
+    return s_ && (s_->generation == generation_) ?
+      static_cast<C*>(s_->p) :
+      nullptr;
+  }
 
-template <class ...Types>
-struct is_std_tuple<std::tuple<Types...> > : std::true_type { };
+  explicit operator bool() const noexcept { return get(); }
+
+  auto slot() const noexcept { return s_; }
+
+  auto generation() const noexcept { return generation_; }
+};
 
 template <typename>
-struct is_std_vector : std::false_type { };
+struct is_weak_handle : std::false_type { };
 
-template <typename T, class Alloc>
-struct is_std_vector<std::vector<T, Alloc> > : std::true_type { };
+template <class C>
+struct is_weak_handle<weak_handle<C> > : std::true_type { };
 
-template <typename T>
-inline std::enable_if_t<
-  std::is_same<std::decay_t<T>, std::string>{} &&
-  !is_nc_reference<T>{},
-  int
->
-set(lua_State* const L, T&& s) noexcept
+// checks the handle in upvalues 4 and 5 and calls the stub in upvalue 6,
+// that finds the object in upvalue 2 and 3, as in any wrapper
+inline int handle_stub(lua_State* const L)
 {
-  lua_pushlstring(L, s.c_str(), s.size());
-
-  return 1;
+  return static_cast<handle_slot*>(
+    lua_touserdata(L, lua_upvalueindex(4)))->generation ==
+    std::uint32_t(lua_tointeger(L, lua_upvalueindex(5))) ?
+    lua_tocfunction(L, lua_upvalueindex(6))(L) :
+    luaL_error(L, "attempt to use a detached object");
 }
 
-template <typename C>
-inline std::enable_if_t<
-  is_std_pair<std::decay_t<C>>{} &&
-  !is_nc_reference<C>{},
-  int
->
-set(lua_State* const L, C&& p) noexcept(
-  noexcept(set(L, p.first), set(L, p.second))
-)
+// replaces the C closures in the table on top by handle stubs
+inline void guard_closures(lua_State* const L, handle_slot* const s,
+  std::uint32_t const generation)
 {
-  set(L, p.first);
-  set(L, p.second);
+  auto const t(lua_gettop(L));
 
-  return 2;
-}
+  lua_pushnil(L);
 
-template <typename ...Types, std::size_t ...I>
-inline void set_tuple_result(lua_State* const L,
-  std::tuple<Types...> const& t, std::index_sequence<I...> const) noexcept(
-    noexcept(swallow{(set(L, std::get<I>(t)), 0)...})
-  )
-{
-  swallow{(set(L, std::get<I>(t)), 0)...};
-}
+  while (lua_next(L, t))
+  {
+    if (auto const f = lua_tocfunction(L, -1))
+    {
+      auto const c(lua_gettop(L));
 
-template <typename C>
-inline std::enable_if_t<
-  is_std_tuple<std::decay_t<C>>{} &&
-  !is_nc_reference<C>{},
-  int
->
-set(lua_State* const L, C&& t) noexcept(
-  noexcept(
-    set_tuple_result(L, t,
-      std::make_index_sequence<std::size_t(std::tuple_size<C>{})>()
-    )
-  )
-)
-{
-  using result_type = std::decay_t<C>;
+      lua_pushvalue(L, c - 1);
 
-  set_tuple_result(L,
-    t,
-    std::make_index_sequence<std::tuple_size<C>{}>()
-  );
+      lua_pushnil(L);
 
-  return std::tuple_size<result_type>{};
+      if (!lua_getupvalue(L, c, 2))
+      {
+        lua_pushnil(L);
+      }
+      // else do nothing
+
+      if (!lua_getupvalue(L, c, 3))
+      {
+        lua_pushnil(L);
+      }
+      // else do nothing
+
+      lua_pushlightuserdata(L, s);
+      lua_pushinteger(L, generation);
+      lua_pushcfunction(L, f);
+
+      lua_pushcclosure(L, handle_stub, 6);
+
+      lua_rawset(L, t);
+    }
+    // else do nothing
+
+    lua_pop(L, 1);
+  }
 }
 
-template <typename C>
+// pushes nil for detached handles; the wrappers of handles can't be
+// captured by value
+template <typename T>
 inline std::enable_if_t<
-  (is_std_array<std::decay_t<C>>{} ||
-  is_std_deque<std::decay_t<C>>{} ||
-  is_std_forward_list<std::decay_t<C>>{} ||
-  is_std_list<std::decay_t<C>>{} ||
-  is_std_vector<std::decay_t<C>>{} ||
-  is_std_set<std::decay_t<C>>{} ||
-  is_std_unordered_set<std::decay_t<C>>{}) &&
-  !is_nc_reference<C>{},
+  is_weak_handle<std::decay_t<T>>{} &&
+  !is_nc_reference<T>{},
   int
 >
-set(lua_State* const L, C&& c)
+set(lua_State* const L, T&& h)
 {
-  lua_createtable(L, c.size(), 0);
+  if (auto const p = h.get())
+  {
+    new_wrapper_table(L, p);
 
-  int j{};
+    lua_pushnil(L);
+    rawsetfield(L, -2, "__wrap");
 
-  auto const cend(c.cend());
+    guard_closures(L, h.slot(), h.generation());
 
-  for (auto i(c.cbegin()); i != cend; ++i)
-  {
-    set(L, *i);
+    lua_setmetatable(L, -2);
 
-    lua_rawseti(L, -2, ++j);
+    guard_closures(L, h.slot(), h.generation());
+  }
+  else
+  {
+    lua_pushnil(L);
   }
 
   return 1;
 }
 
-template <typename C>
+template <typename T>
 inline std::enable_if_t<
-  (is_std_map<std::decay_t<C>>{} ||
-  is_std_unordered_map<std::decay_t<C>>{}) &&
-  !is_nc_reference<C>{},
+  std::is_same<std::decay_t<T>, any>{} &&
+  !is_nc_reference<T>{},
   int
 >
-set(lua_State* const L, C&& m)
+set(lua_State* const, T&&) noexcept
 {
-  lua_createtable(L, 0, m.size());
-
-  auto const cend(m.cend());
-
-  for (auto i(m.cbegin()); i != cend; ++i)
-  {
-    set(L, i->first);
-    set(L, i->second);
-
-    lua_rawset(L, -3);
-  }
-
   return 1;
 }
 
-template <int I, class C>
+template <int I, typename T>
 inline std::enable_if_t<
-  std::is_same<std::decay_t<C>, std::string>{} &&
-  !is_nc_reference<C>{},
-  std::decay_t<C>
+  std::is_floating_point<std::decay_t<T>>{} &&
+  !is_nc_reference<T>{},
+  std::decay_t<T>
 >
-get(lua_State* const L)
+get(lua_State* const L) noexcept
 {
-  assert(lua_isstring(L, I));
-
-  std::size_t len;
-
-  auto const s(lua_tolstring(L, I, &len));
-
-  return {s, len};
+  assert(lua_isnumber(L, I));
+  return lua_tonumber(L, I);
 }
 
-template<int I, class C>
+template <int I, typename T>
 inline std::enable_if_t<
-  is_std_pair<std::decay_t<C>>{} &&
-  !is_nc_reference<C>{},
-  std::decay_t<C>
+  std::is_integral<std::decay_t<T>>{} &&
+  !std::is_same<std::decay_t<T>, bool>{} &&
+  !is_nc_reference<T>{},
+  std::decay_t<T>
 >
-get(lua_State* const L)
+get(lua_State* const L) noexcept
 {
-  assert(lua_istable(L, I));
- 
-  using result_type = std::decay_t<C>;
-
-  lua_rawgeti(L, -1, 1);
-  lua_rawgeti(L, -2, 2);
+  assert(lua_isnumber(L, I));
+  return lua_tointeger(L, I);
+}
 
-  result_type const result(
-    get<-2, typename result_type::first_type>(L),
-    get<-1, typename result_type::second_type>(L)
-  );
-
-  lua_pop(L, 2);
-
-  return result;
+template <int I, typename T>
+inline std::enable_if_t<
+  std::is_same<std::decay_t<T>, bool>{} &&
+  !is_nc_reference<T>{},
+  std::decay_t<T>
+>
+get(lua_State* const L) noexcept
+{
+  assert(lua_isboolean(L, I));
+  return lua_toboolean(L, I);
 }
 
-template <std::size_t O, class C, std::size_t ...I>
-inline C get_tuple_arg(lua_State* const L,
-  std::index_sequence<I...> const) noexcept(
-    noexcept(std::make_tuple(get<int(I - sizeof...(I)),
-      std::tuple_element_t<I, C>>(L)...)
-    )
-  )
+template <int I, typename T>
+inline std::enable_if_t<
+  std::is_same<std::decay_t<T>, char const*>{} &&
+  !is_nc_reference<T>{},
+  std::decay_t<T>
+>
+get(lua_State* const L) noexcept
 {
-  swallow{(lua_rawgeti(L, O, I + 1), 0)...};
-
-  C result(std::make_tuple(get<int(I - sizeof...(I)),
-    std::tuple_element_t<I, C>>(L)...));
-
-  lua_pop(L, int(sizeof...(I)));
-
-  return result;
+  assert(lua_isstring(L, I));
+  return lua_tostring(L, I);
 }
 
-template <int I, class C>
+template <int I, typename T>
 inline std::enable_if_t<
-  is_std_tuple<std::decay_t<C>>{} &&
-  !is_nc_reference<C>{},
-  std::decay_t<C>
+  std::is_pointer<T>{} &&
+  !std::is_same<std::decay_t<T>, char const*>{},
+  std::decay_t<T>
 >
-get(lua_State* const L) noexcept(
-  noexcept(get_tuple_arg<I,
-    std::decay_t<C>>(L,
-      std::make_index_sequence<
-        std::size_t(std::tuple_size<std::decay_t<C>>{})
-      >()
-    )
-  )
-)
+get(lua_State* const L) noexcept
 {
-  assert(lua_istable(L, I));
-
-  using result_type = std::decay_t<C>;
-
-  return get_tuple_arg<I, result_type>(L,
-    std::make_index_sequence<std::tuple_size<result_type>{}>()
-  );
+  assert(lua_islightuserdata(L, I));
+  return static_cast<T>(lua_touserdata(L, I));
 }
 
-template<int I, class C>
+template <int I, typename T>
 inline std::enable_if_t<
-  is_std_array<std::decay_t<C>>{} &&
-  !is_nc_reference<C>{},
-  std::decay_t<C>
+  is_nc_reference<T>{},
+  T
 >
-get(lua_State* const L)
+get(lua_State* const L) noexcept
 {
-  assert(lua_istable(L, I));
-
-  using result_type = std::decay_t<C>;
-  result_type result;
-
-  auto const len(std::min(lua_rawlen(L, I), lua_Unsigned(result.size())));
-
-  for (decltype(lua_rawlen(L, I)) i{}; i != len; ++i)
-  {
-    lua_rawgeti(L, I, i + 1);
-
-    result[i] = get<-1, typename result_type::value_type>(L);
-  }
-
-  lua_pop(L, len);
-
-  return result;
+  assert(lua_islightuserdata(L, I));
+  return *static_cast<std::decay_t<T>*>(lua_touserdata(L, I));
 }
 
-template <int I, class C>
+template <int I, typename T>
 inline std::enable_if_t<
-  (is_std_deque<std::decay_t<C>>{} ||
-  is_std_forward_list<std::decay_t<C>>{} ||
-  is_std_list<std::decay_t<C>>{}) &&
-  !is_nc_reference<C>{},
-  std::decay_t<C>
+  std::is_same<std::remove_const_t<T>, any>{},
+  T
 >
-get(lua_State* const L)
+get(lua_State* const) noexcept
 {
-  assert(lua_istable(L, I));
+  return {};
+}
 
-  using result_type = std::decay_t<C>;
-  result_type result;
+// lua type an argument of type T is expected to have, LUA_TNONE matches any
+template <typename T, typename = void>
+struct lua_type_of : std::integral_constant<int, LUA_TNONE> { };
 
-  auto const len(lua_rawlen(L, I));
+template <typename T>
+struct lua_type_of<T,
+  std::enable_if_t<
+    std::is_arithmetic<std::decay_t<T>>{} &&
+    !std::is_same<std::decay_t<T>, bool>{} &&
+    !is_nc_reference<T>{}
+  >
+> : std::integral_constant<int, LUA_TNUMBER> { };
 
-  for (auto i(len); i; --i)
-  {
-    lua_rawgeti(L, I, i);
+template <typename T>
+struct lua_type_of<T,
+  std::enable_if_t<
+    std::is_same<std::decay_t<T>, bool>{} &&
+    !is_nc_reference<T>{}
+  >
+> : std::integral_constant<int, LUA_TBOOLEAN> { };
 
-    result.emplace_front(get<-1, typename result_type::value_type>(L));
-  }
+template <typename T>
+struct lua_type_of<T,
+  std::enable_if_t<
+    std::is_same<std::decay_t<T>, char const*>{} &&
+    !is_nc_reference<T>{}
+  >
+> : std::integral_constant<int, LUA_TSTRING> { };
 
-  lua_pop(L, len);
+template <typename T>
+struct lua_type_of<T,
+  std::enable_if_t<
+    (std::is_pointer<T>{} &&
+    !std::is_same<std::decay_t<T>, char const*>{}) ||
+    is_nc_reference<T>{}
+  >
+> : std::integral_constant<int, LUA_TLIGHTUSERDATA> { };
 
-  return result;
-}
+// thrown, when a lua function called from C++ raises an error
+class error : public std::runtime_error
+{
+public:
+  using std::runtime_error::runtime_error;
+};
 
-template <int I, class C>
-inline std::enable_if_t<
-  is_std_vector<std::decay_t<C>>{} &&
-  !is_nc_reference<C>{},
-  std::decay_t<C>
->
-get(lua_State* const L)
+// a snapshot of a lua value, that can be pushed into any state; tables are
+// copied with their nesting and sharing, but without their metatables,
+// bound objects are referred to and must outlive the snapshot
+class value
 {
-  assert(lua_istable(L, I));
+  enum tag : unsigned char
+  {
+    NIL,
+    BOOLEAN,
+    INTEGER,
+    NUMBER,
+    STRING,
+    LIGHTUSERDATA,
+    OBJECT,
+    TABLE,
+    REFERENCE
+  };
 
-  using result_type = std::decay_t<C>;
-  result_type result;
+  // tags, each followed by its payload, tables by their array and record
+  // sizes and contents
+  std::vector<char> data_;
 
-  auto const cend(lua_rawlen(L, I) + 1);
+  bool references_{};
 
-  result.reserve(cend - 1);
+  // of nested tables
+  static constexpr unsigned const max_depth = 200;
 
-  for (decltype(lua_rawlen(L, I)) i(1); i != cend; ++i)
+  template <typename T>
+  void write(T const& v)
   {
-    lua_rawgeti(L, I, i);
+    auto const p(reinterpret_cast<char const*>(&v));
 
-    result.emplace_back(get<-1, typename result_type::value_type>(L));
+    data_.insert(data_.end(), p, p + sizeof(v));
   }
 
-  lua_pop(L, cend - 1);
-
-  return result;
-}
+  template <typename T>
+  static T read(char const*& p) noexcept
+  {
+    T v;
 
-template <int I, class C>
-inline std::enable_if_t<
-  (is_std_map<std::decay_t<C>>{} ||
-  is_std_unordered_map<std::decay_t<C>>{}) &&
-  !is_nc_reference<C>{},
-  std::decay_t<C>
->
-get(lua_State* const L)
-{
-  assert(lua_istable(L, I));
+    std::memcpy(&v, p, sizeof(v));
+    p += sizeof(v);
 
-  using result_type = std::decay_t<C>;
-  result_type result;
+    return v;
+  }
 
-  lua_pushnil(L);
+  using tables_type = std::unordered_map<void const*, std::uint32_t>;
 
-  while (lua_next(L, I))
+  void capture(lua_State* const L, int const i, tables_type& tables,
+    unsigned const depth)
   {
-    result.emplace(get<-2, typename result_type::key_type>(L),
-      get<-1, typename result_type::mapped_type>(L)
-    );
-
-    lua_pop(L, 1);
-  }
-
-  return result;
-}
+    switch (lua_type(L, i))
+    {
+      case LUA_TNIL:
+        write(NIL);
 
-template <int I, class C>
-inline std::enable_if_t<
-  (is_std_set<std::decay_t<C>>{} ||
-  is_std_unordered_set<std::decay_t<C>>{}) &&
-  !is_nc_reference<C>{},
-  std::decay_t<C>
->
-get(lua_State* const L)
-{
-  assert(lua_istable(L, I));
+        break;
 
-  using result_type = std::decay_t<C>;
-  result_type result;
+      case LUA_TBOOLEAN:
+        write(BOOLEAN);
+        write(static_cast<unsigned char>(lua_toboolean(L, i)));
 
-  auto const end(lua_rawlen(L, I) + 1);
+        break;
 
-  for (decltype(lua_rawlen(L, I)) i(1); i != end; ++i)
-  {
-    lua_rawgeti(L, I, i);
+      case LUA_TNUMBER:
+        if (lua_isinteger(L, i))
+        {
+          write(INTEGER);
+          write(lua_tointeger(L, i));
+        }
+        else
+        {
+          write(NUMBER);
+          write(lua_tonumber(L, i));
+        }
 
-    result.emplace(get<-1, typename result_type::value_type>(L));
-  }
+        break;
 
-  lua_pop(L, end - 1);
+      case LUA_TSTRING:
+        {
+          std::size_t l;
 
-  return result;
-}
+          auto const s(lua_tolstring(L, i, &l));
 
-#endif // LUALITE_NO_STD_CONTAINERS
+          write(STRING);
+          write(l);
 
-template <class C>
-int default_finalizer(lua_State* const L)
-  noexcept(noexcept(std::declval<C>().~C()))
-{
-  delete static_cast<C*>(lua_touserdata(L, lua_upvalueindex(1)));
+          data_.insert(data_.end(), s, s + l);
+        }
 
-  return {};
-}
+        break;
 
-template <std::size_t O, typename C, typename ...A, std::size_t ...I>
-inline std::enable_if_t<bool(!sizeof...(A)), C*>
-forward(lua_State* const, std::index_sequence<I...> const) noexcept(
-  noexcept(C())
-)
-{
-  return new C();
-}
+      case LUA_TLIGHTUSERDATA:
+        write(LIGHTUSERDATA);
+        write(lua_touserdata(L, i));
 
-template <std::size_t O, typename C, typename ...A, std::size_t ...I>
-inline std::enable_if_t<bool(sizeof...(A)), C*>
-forward(lua_State* const L, std::index_sequence<I...> const) noexcept(
-  noexcept(C(get<I + O, A>(L)...))
-)
-{
-  return new C(get<I + O, A>(L)...);
-}
+        break;
 
-template <std::size_t O, class C, class ...A>
-int constructor_stub(lua_State* const L)
-  noexcept(noexcept(
-    forward<O, C, A...>(L, std::make_index_sequence<sizeof...(A)>()))
-  )
-{
-  assert(sizeof...(A) == lua_gettop(L));
+      case LUA_TTABLE:
+        capture_table(L, i, tables, depth);
 
-  auto const instance(forward<O, C, A...>(L,
-    std::make_index_sequence<sizeof...(A)>())
-  );
+        break;
 
-  // table
-  lua_createtable(L, 0, default_nrec);
+      default:
+        throw error(lua_pushfstring(L, "cannot capture a %s",
+          luaL_typename(L, i)));
+    }
+  }
 
-  for (auto& mi: lualite::class_<C>::defs())
+  void capture_table(lua_State* const L, int const i, tables_type& tables,
+    unsigned const depth)
   {
-    assert(lua_istable(L, -1));
-
-    void* p(instance);
-
-    for (auto const f: mi.first)
+    if ((max_depth == depth) || !lua_checkstack(L, 3))
     {
-      p = f(p);
+      throw error("cannot capture, table nested too deeply");
     }
+    // else do nothing
 
-    lua_pushnil(L);
-    lua_pushlightuserdata(L, p);
-    lua_pushcclosure(L, mi.second.callback, 2);
+    // bound objects
+    if (lua_getmetatable(L, i))
+    {
+      rawgetfield(L, -1, "__wrap");
 
-    rawsetfield(L, -2, mi.second.name);
-  }
+      if (lua_iscfunction(L, -1) && lua_getupvalue(L, -1, 2))
+      {
+        write(OBJECT);
+        write(lua_tocfunction(L, -2));
+        write(lua_touserdata(L, -1));
 
-  // metatable
-  assert(lua_istable(L, -1));
-  lua_createtable(L, 0, 3);
+        lua_pop(L, 3);
 
-  // gc
-  assert(lua_istable(L, -1));
-  lua_pushlightuserdata(L, instance);
+        return;
+      }
+      // else do nothing
 
-  lua_pushcclosure(L, default_finalizer<C>, 1);
+      lua_pop(L, 2);
+    }
+    // else do nothing
 
-  rawsetfield(L, -2, "__gc");
+    auto const r(tables.emplace(lua_topointer(L, i), tables.size()));
 
-  // getters
-  assert(lua_istable(L, -1));
+    if (!r.second)
+    {
+      references_ = true;
 
-  lua_pushnil(L);
-  lua_pushlightuserdata(L, instance);
+      write(REFERENCE);
+      write(r.first->second);
 
-  lua_pushcclosure(L, getter<C>, 2);
+      return;
+    }
+    // else do nothing
 
-  rawsetfield(L, -2, "__index");
+    write(TABLE);
 
-  // setters
-  assert(lua_istable(L, -1));
+    auto const h(data_.size());
 
-  lua_pushnil(L);
-  lua_pushlightuserdata(L, instance);
+    auto const narr(static_cast<std::uint32_t>(lua_rawlen(L, i)));
+    std::uint32_t nrec{};
 
-  lua_pushcclosure(L, setter<C>, 2);
+    write(narr);
+    write(nrec);
 
-  rawsetfield(L, -2, "__newindex");
+    for (lua_Integer j{1}; j <= narr; ++j)
+    {
+      lua_rawgeti(L, i, j);
 
-  lua_setmetatable(L, -2);
+      capture(L, lua_gettop(L), tables, depth + 1);
+
+      lua_pop(L, 1);
+    }
+
+    lua_pushnil(L);
+
+    while (lua_next(L, i))
+    {
+      auto const top(lua_gettop(L));
+
+      if (!lua_isinteger(L, -2) ||
+        (lua_tointeger(L, -2) < 1) ||
+        (lua_tointeger(L, -2) > narr))
+      {
+        capture(L, top - 1, tables, depth + 1);
+        capture(L, top, tables, depth + 1);
+
+        ++nrec;
+      }
+      // else do nothing
+
+      lua_pop(L, 1);
+    }
+
+    std::memcpy(&data_[h + sizeof(narr)], &nrec, sizeof(nrec));
+  }
+
+  static void rebuild(lua_State* const L, char const*& p, int const seen,
+    lua_Integer& n, unsigned const depth)
+  {
+    switch (read<tag>(p))
+    {
+      case NIL:
+        lua_pushnil(L);
+
+        break;
+
+      case BOOLEAN:
+        lua_pushboolean(L, read<unsigned char>(p));
+
+        break;
+
+      case INTEGER:
+        lua_pushinteger(L, read<lua_Integer>(p));
+
+        break;
+
+      case NUMBER:
+        lua_pushnumber(L, read<lua_Number>(p));
+
+        break;
+
+      case STRING:
+        {
+          auto const l(read<std::size_t>(p));
+
+          lua_pushlstring(L, p, l);
+          p += l;
+        }
+
+        break;
+
+      case LIGHTUSERDATA:
+        lua_pushlightuserdata(L, read<void*>(p));
+
+        break;
+
+      case OBJECT:
+        {
+          auto const f(read<lua_CFunction>(p));
+
+          lua_pushnil(L);
+          lua_pushlightuserdata(L, read<void*>(p));
+
+          lua_pushcclosure(L, f, 2);
+          lua_call(L, 0, 1);
+        }
+
+        break;
+
+      case TABLE:
+        {
+          if ((max_depth == depth) || !lua_checkstack(L, 3))
+          {
+            throw error("cannot push a value, nested too deeply");
+          }
+          // else do nothing
+
+          auto const narr(read<std::uint32_t>(p));
+          auto const nrec(read<std::uint32_t>(p));
+
+          lua_createtable(L, size_hint(narr), size_hint(nrec));
+
+          if (seen)
+          {
+            lua_pushvalue(L, -1);
+            lua_rawseti(L, seen, ++n);
+          }
+          // else do nothing
+
+          for (lua_Integer i{1}; i <= narr; ++i)
+          {
+            rebuild(L, p, seen, n, depth + 1);
+
+            if (lua_isnil(L, -1))
+            {
+              lua_pop(L, 1);
+            }
+            else
+            {
+              lua_rawseti(L, -2, i);
+            }
+          }
+
+          for (auto i(nrec); i; --i)
+          {
+            rebuild(L, p, seen, n, depth + 1);
+            rebuild(L, p, seen, n, depth + 1);
+
+            lua_rawset(L, -3);
+          }
+        }
+
+        break;
+
+      case REFERENCE:
+        lua_rawgeti(L, seen, read<std::uint32_t>(p) + 1);
+
+        break;
+
+      default:
+        assert(0);
+    }
+  }
+
+public:
+  value() = default;
+
+  value(lua_State* const L, int index)
+  {
+    index = lua_absindex(L, index);
+
+    auto const top(lua_gettop(L));
+
+    tables_type tables;
+
+    try
+    {
+      capture(L, index, tables, 0);
+    }
+    catch (...)
+    {
+      lua_settop(L, top);
+
+      throw;
+    }
+  }
+
+  // size of the snapshot in bytes
+  auto size() const noexcept { return data_.size(); }
+
+  int push(lua_State* const L) const
+  {
+    if (data_.empty())
+    {
+      lua_pushnil(L);
+    }
+    else
+    {
+      auto const top(lua_gettop(L));
+
+      int seen{};
+
+      if (references_)
+      {
+        lua_newtable(L);
+        seen = lua_gettop(L);
+      }
+      // else do nothing
+
+      auto p(data_.data());
+      lua_Integer n{};
+
+      try
+      {
+        rebuild(L, p, seen, n, 0);
+      }
+      catch (...)
+      {
+        lua_settop(L, top);
+
+        throw;
+      }
+
+      assert(data_.data() + data_.size() == p);
+
+      if (seen)
+      {
+        lua_remove(L, seen);
+      }
+      // else do nothing
+    }
+
+    return 1;
+  }
+};
+
+template <int I, typename T>
+inline std::enable_if_t<
+  std::is_same<std::decay_t<T>, value>{} &&
+  !is_nc_reference<T>{},
+  std::decay_t<T>
+>
+get(lua_State* const L)
+{
+  return {L, I};
+}
+
+template <typename T>
+inline std::enable_if_t<
+  std::is_same<std::decay_t<T>, value>{} &&
+  !is_nc_reference<T>{},
+  int
+>
+set(lua_State* const L, T&& v)
+{
+  return v.push(L);
+}
+
+template <typename C, typename = void>
+struct uses_scratch : std::false_type { };
+
+template <bool>
+struct scratch_scope_impl
+{
+  explicit scratch_scope_impl(lua_State*) noexcept
+  {
+  }
+};
+
+// a std::pmr container argument taken by const reference, that can't be
+// moved out of the call, only copied
+template <typename A>
+using is_scratch_argument = std::integral_constant<bool,
+  uses_scratch<std::decay_t<A>>{} &&
+  std::is_lvalue_reference<A>{} &&
+  std::is_const<std::remove_reference_t<A>>{}
+>;
+
+// marks the arguments of a stub as being converted and used; the scratch
+// is used, if the stub takes std::pmr containers, all by const reference
+template <typename ...A>
+using scratch_scope = scratch_scope_impl<
+  !all_true<!uses_scratch<std::decay_t<A>>{}...>{} &&
+  all_true<
+    (!uses_scratch<std::decay_t<A>>{} || is_scratch_argument<A>{})...
+  >{}
+>;
+
+#ifndef LUALITE_NO_STD_CONTAINERS
+
+#if (__cplusplus >= 201703L) && (LUA_VERSION_NUM >= 504)
+
+// a monotonic arena for std::pmr container arguments; while a stub, taking
+// such arguments by const reference only, runs, they are allocated from the
+// scratch of its state, that is released, when the outermost such stub
+// returns or fails; a coroutine, failing inside such a stub, holds the
+// scratch until it is closed; copies of the arguments use the default
+// resource, references to them must not escape the call. The scratch needs
+// to-be-closed slots, before lua 5.4 arguments use the default resource
+class scratch
+{
+  friend struct scratch_scope_impl<true>;
+
+  lua_State* const L_;
+
+  std::unique_ptr<char[]> const buffer_;
+
+  std::pmr::monotonic_buffer_resource r_;
+
+  unsigned depth_{};
+
+  static void const* key() noexcept
+  {
+    static char const k{};
+
+    return &k;
+  }
+
+  // pushes the closer of the state's scratch, a userdata pointing to it
+  static scratch* push(lua_State* const L) noexcept
+  {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, key());
+
+    auto const p(static_cast<scratch**>(lua_touserdata(L, -1)));
+
+    return p ? *p : nullptr;
+  }
+
+  static scratch* of(lua_State* const L) noexcept
+  {
+    auto const s(push(L));
+
+    lua_pop(L, 1);
+
+    return s;
+  }
+
+  // leaves a stub; also runs, when a lua error unwinds the stub, skipping
+  // the destructors of its scope
+  static void leave(scratch* const s) noexcept
+  {
+    if (s && !--s->depth_)
+    {
+      s->r_.release();
+    }
+    // else do nothing
+  }
+
+  static int close(lua_State* const L) noexcept
+  {
+    leave(*static_cast<scratch**>(lua_touserdata(L, 1)));
+
+    return 0;
+  }
+
+public:
+  // arguments exceeding size are allocated from the default resource, until
+  // the scratch is released
+  explicit scratch(lua_State* const L, std::size_t const size = 65536) :
+    L_(L),
+    buffer_(new char[size]),
+    r_(buffer_.get(), size)
+  {
+    *static_cast<scratch**>(lua_newuserdata(L, sizeof(scratch*))) = this;
+
+    lua_createtable(L, 0, 1);
+    lua_pushcfunction(L, close);
+    rawsetfield(L, -2, "__close");
+    lua_setmetatable(L, -2);
+
+    lua_rawsetp(L, LUA_REGISTRYINDEX, key());
+  }
+
+  scratch(scratch const&) = delete;
+
+  scratch& operator=(scratch const&) = delete;
+
+  ~scratch() noexcept
+  {
+    push(L_);
+    *static_cast<scratch**>(lua_touserdata(L_, -1)) = nullptr;
+    lua_pop(L_, 1);
+
+    lua_pushnil(L_);
+    lua_rawsetp(L_, LUA_REGISTRYINDEX, key());
+  }
+
+  // the default resource, outside of stubs
+  static std::pmr::memory_resource* resource(lua_State* const L) noexcept
+  {
+    auto const s(of(L));
+
+    return s && s->depth_ ?
+      &s->r_ :
+      std::pmr::get_default_resource();
+  }
+};
+
+template <typename C>
+struct uses_scratch<C,
+  std::enable_if_t<
+    std::is_same<typename C::allocator_type,
+      std::pmr::polymorphic_allocator<typename C::value_type>
+    >{}
+  >
+> : std::true_type { };
+
+// the scope is left by closing the closer, marked to be closed on entry, so
+// that lua errors, unwinding the stub, leave it as well
+template <>
+struct scratch_scope_impl<true>
+{
+  lua_State* const L_;
+
+  int const top_;
+
+  scratch* const s_;
+
+  explicit scratch_scope_impl(lua_State* const L) noexcept :
+    L_(L),
+    top_(lua_gettop(L)),
+    s_(scratch::push(L))
+  {
+    if (s_)
+    {
+      ++s_->depth_;
+
+      lua_toclose(L, -1);
+    }
+    // else do nothing
+  }
+
+  scratch_scope_impl(scratch_scope_impl const&) = delete;
+
+  scratch_scope_impl& operator=(scratch_scope_impl const&) = delete;
+
+  ~scratch_scope_impl() noexcept
+  {
+    lua_settop(L_, top_);
+  }
+};
+
+template <typename C>
+inline std::enable_if_t<uses_scratch<C>{}, C>
+make_container(lua_State* const L)
+{
+  return C(typename C::allocator_type(scratch::resource(L)));
+}
+
+#endif // __cplusplus, LUA_VERSION_NUM
+
+template <typename C>
+inline std::enable_if_t<!uses_scratch<C>{}, C>
+make_container(lua_State* const)
+{
+  return C();
+}
+
+template <typename>
+struct is_std_pair : std::false_type { };
+
+template <class T1, class T2>
+struct is_std_pair<std::pair<T1, T2> > : std::true_type { };
+
+template <typename>
+struct is_std_array : std::false_type { };
+
+template <typename T, std::size_t N>
+struct is_std_array<std::array<T, N> > : std::true_type { };
+
+template <typename>
+struct is_std_deque : std::false_type { };
+
+template <typename T, class Alloc>
+struct is_std_deque<std::deque<T, Alloc> > : std::true_type { };
+
+template <typename>
+struct is_std_forward_list : std::false_type { };
+
+template <typename T, class Alloc>
+struct is_std_forward_list<std::forward_list<T, Alloc> > : std::true_type { };
+
+template <typename>
+struct is_std_list : std::false_type { };
+
+template <typename T, class Alloc>
+struct is_std_list<std::list<T, Alloc> > : std::true_type { };
+
+template <typename>
+struct is_std_map : std::false_type { };
+
+template <class Key, class T, class Compare, class Alloc>
+struct is_std_map<std::map<Key, T, Compare, Alloc> > : std::true_type { };
+
+template <typename>
+struct is_std_set : std::false_type { };
+
+template <class Key, class Compare, class Alloc>
+struct is_std_set<std::set<Key, Compare, Alloc> > : std::true_type { };
+
+template <typename>
+struct is_std_unordered_map : std::false_type { };
+
+template <class Key, class T, class Hash, class P, class Alloc>
+struct is_std_unordered_map<std::unordered_map<Key, T, Hash, P, Alloc> > :
+  std::true_type { };
+
+template <typename>
+struct is_std_unordered_set : std::false_type { };
+
+template <class Key, class Hash, class Equal, class Alloc>
+struct is_std_unordered_set<std::unordered_set<Key, Hash, Equal, Alloc> > :
+  std::true_type { };
+
+template <typename>
+struct is_std_tuple : std::false_type { };
+
+template <class ...Types>
+struct is_std_tuple<std::tuple<Types...> > : std::true_type { };
+
+template <typename>
+struct is_std_vector : std::false_type { };
+
+template <typename T, class Alloc>
+struct is_std_vector<std::vector<T, Alloc> > : std::true_type { };
+
+// vectors of numbers are converted in blocks of numeric_block elements
+template <typename>
+struct is_numeric_vector : std::false_type { };
+
+template <typename T, class Alloc>
+struct is_numeric_vector<std::vector<T, Alloc> > :
+  std::integral_constant<bool,
+    std::is_arithmetic<T>{} && !std::is_same<T, bool>{}
+  >
+{
+};
+
+static constexpr auto const numeric_block = 64;
+
+template <typename>
+struct is_std_string : std::false_type { };
+
+template <class A>
+struct is_std_string<std::basic_string<char, std::char_traits<char>, A> > :
+  std::true_type { };
+
+template <typename T>
+struct lua_type_of<T,
+  std::enable_if_t<
+    is_std_string<std::decay_t<T>>{} &&
+    !is_nc_reference<T>{}
+  >
+> : std::integral_constant<int, LUA_TSTRING> { };
+
+template <typename T>
+struct lua_type_of<T,
+  std::enable_if_t<
+    (is_std_pair<std::decay_t<T>>{} ||
+    is_std_tuple<std::decay_t<T>>{} ||
+    is_std_array<std::decay_t<T>>{} ||
+    is_std_deque<std::decay_t<T>>{} ||
+    is_std_forward_list<std::decay_t<T>>{} ||
+    is_std_list<std::decay_t<T>>{} ||
+    is_std_vector<std::decay_t<T>>{} ||
+    is_std_map<std::decay_t<T>>{} ||
+    is_std_set<std::decay_t<T>>{} ||
+    is_std_unordered_map<std::decay_t<T>>{} ||
+    is_std_unordered_set<std::decay_t<T>>{}) &&
+    !is_nc_reference<T>{}
+  >
+> : std::integral_constant<int, LUA_TTABLE> { };
+
+template <typename T>
+inline std::enable_if_t<
+  is_std_string<std::decay_t<T>>{} &&
+  !is_nc_reference<T>{},
+  int
+>
+set(lua_State* const L, T&& s) noexcept
+{
+  lua_pushlstring(L, s.c_str(), s.size());
+
+  return 1;
+}
+
+template <typename C>
+inline std::enable_if_t<
+  is_std_pair<std::decay_t<C>>{} &&
+  !is_nc_reference<C>{},
+  int
+>
+set(lua_State* const L, C&& p) noexcept(
+  noexcept(set(L, p.first), set(L, p.second))
+)
+{
+  set(L, p.first);
+  set(L, p.second);
+
+  return 2;
+}
+
+template <typename ...Types, std::size_t ...I>
+inline void set_tuple_result(lua_State* const L,
+  std::tuple<Types...> const& t, std::index_sequence<I...> const) noexcept(
+    noexcept(swallow{(set(L, std::get<I>(t)), 0)...})
+  )
+{
+  swallow{(set(L, std::get<I>(t)), 0)...};
+}
+
+template <typename C>
+inline std::enable_if_t<
+  is_std_tuple<std::decay_t<C>>{} &&
+  !is_nc_reference<C>{},
+  int
+>
+set(lua_State* const L, C&& t) noexcept(
+  noexcept(
+    set_tuple_result(L, t,
+      std::make_index_sequence<std::size_t(std::tuple_size<C>{})>()
+    )
+  )
+)
+{
+  using result_type = std::decay_t<C>;
+
+  set_tuple_result(L,
+    t,
+    std::make_index_sequence<std::tuple_size<C>{}>()
+  );
+
+  return std::tuple_size<result_type>{};
+}
+
+template <typename C>
+inline std::enable_if_t<
+  is_numeric_vector<std::decay_t<C>>{} &&
+  !is_nc_reference<C>{},
+  int
+>
+set(lua_State* const L, C&& c) noexcept
+{
+  auto const n(lua_Integer(c.size()));
+
+  lua_createtable(L, size_hint(c.size()), 0);
+
+  auto const t(lua_gettop(L));
+
+  auto const p(static_cast<std::decay_t<C> const&>(c).data());
+
+  for (lua_Integer i{}; i != n; ++i)
+  {
+    set(L, p[i]);
+
+    lua_rawseti(L, t, i + 1);
+  }
+
+  return 1;
+}
+
+template <typename C>
+inline std::enable_if_t<
+  (is_std_array<std::decay_t<C>>{} ||
+  is_std_deque<std::decay_t<C>>{} ||
+  is_std_forward_list<std::decay_t<C>>{} ||
+  is_std_list<std::decay_t<C>>{} ||
+  is_std_vector<std::decay_t<C>>{} ||
+  is_std_set<std::decay_t<C>>{} ||
+  is_std_unordered_set<std::decay_t<C>>{}) &&
+  !is_numeric_vector<std::decay_t<C>>{} &&
+  !is_nc_reference<C>{},
+  int
+>
+set(lua_State* const L, C&& c)
+{
+  lua_createtable(L, size_hint(c.size()), 0);
+
+  int j{};
+
+  auto const cend(c.cend());
+
+  for (auto i(c.cbegin()); i != cend; ++i)
+  {
+    set(L, *i);
+
+    lua_rawseti(L, -2, ++j);
+  }
+
+  return 1;
+}
+
+template <typename C, typename = void>
+struct has_reserve : std::false_type { };
+
+template <typename C>
+struct has_reserve<C,
+  decltype(void(std::declval<C&>().reserve(std::size_t())))
+> : std::true_type { };
+
+// lua has no count of the hash part and counting it costs a traversal,
+// about as much as the rehashes saved, so reading only reserves the array
+// part; pushing sizes both parts from size()
+template <typename C>
+inline std::enable_if_t<has_reserve<C>{}>
+reserve_table(lua_State* const L, int const t, C& c) noexcept(
+  noexcept(c.reserve(std::size_t()))
+)
+{
+  if (auto const n = lua_rawlen(L, t))
+  {
+    c.reserve(n);
+  }
+  // else do nothing
+}
+
+template <typename C>
+inline std::enable_if_t<!has_reserve<C>{}>
+reserve_table(lua_State* const, int const, C&) noexcept
+{
+}
+
+template <typename T>
+struct is_integer_key :
+  std::integral_constant<bool,
+    std::is_integral<T>{} && !std::is_same<T, bool>{}
+  >
+{
+};
+
+template <typename C>
+inline std::enable_if_t<!is_integer_key<typename C::key_type>{}>
+set_map(lua_State* const L, C const& m)
+{
+  lua_createtable(L, 0, size_hint(m.size()));
+
+  auto const cend(m.cend());
+
+  for (auto i(m.cbegin()); i != cend; ++i)
+  {
+    set(L, i->first);
+    set(L, i->second);
+
+    lua_rawset(L, -3);
+  }
+}
+
+// keys 1..size go into the array part
+template <typename C>
+inline std::enable_if_t<is_integer_key<typename C::key_type>{}>
+set_map(lua_State* const L, C const& m)
+{
+  auto const n(lua_Unsigned(m.size()));
+
+  std::size_t narr{};
+
+  for (auto& e: m)
+  {
+    auto const k(lua_Integer(e.first));
+
+    narr += (k >= 1) && (lua_Unsigned(k) <= n);
+  }
+
+  lua_createtable(L, size_hint(narr), size_hint(m.size() - narr));
+
+  auto const t(lua_gettop(L));
+
+  auto const cend(m.cend());
+
+  for (auto i(m.cbegin()); i != cend; ++i)
+  {
+    set(L, i->second);
+
+    lua_rawseti(L, t, lua_Integer(i->first));
+  }
+}
+
+template <typename C>
+inline std::enable_if_t<
+  (is_std_map<std::decay_t<C>>{} ||
+  is_std_unordered_map<std::decay_t<C>>{}) &&
+  !is_nc_reference<C>{},
+  int
+>
+set(lua_State* const L, C&& m)
+{
+  set_map(L, static_cast<std::decay_t<C> const&>(m));
+
+  return 1;
+}
+
+template <int I, class C>
+inline std::enable_if_t<
+  is_std_string<std::decay_t<C>>{} &&
+  !is_nc_reference<C>{},
+  std::decay_t<C>
+>
+get(lua_State* const L)
+{
+  assert(lua_isstring(L, I));
+
+  std::size_t len;
+
+  auto const s(lua_tolstring(L, I, &len));
+
+  auto result(make_container<std::decay_t<C>>(L));
+
+  result.assign(s, len);
+
+  return result;
+}
+
+template<int I, class C>
+inline std::enable_if_t<
+  is_std_pair<std::decay_t<C>>{} &&
+  !is_nc_reference<C>{},
+  std::decay_t<C>
+>
+get(lua_State* const L)
+{
+  assert(lua_istable(L, I));
+  auto const i(lua_absindex(L, I));
+
+  using result_type = std::decay_t<C>;
+
+  lua_rawgeti(L, i, 1);
+  lua_rawgeti(L, i, 2);
+
+  result_type const result(
+    get<-2, typename result_type::first_type>(L),
+    get<-1, typename result_type::second_type>(L)
+  );
+
+  lua_pop(L, 2);
+
+  return result;
+}
+
+template <class C, std::size_t ...I>
+inline C get_tuple_arg(lua_State* const L, int const i,
+  std::index_sequence<I...> const) noexcept(
+    noexcept(std::make_tuple(get<int(I - sizeof...(I)),
+      std::tuple_element_t<I, C>>(L)...)
+    )
+  )
+{
+  swallow{(lua_rawgeti(L, i, I + 1), 0)...};
+
+  C result(std::make_tuple(get<int(I - sizeof...(I)),
+    std::tuple_element_t<I, C>>(L)...));
+
+  lua_pop(L, int(sizeof...(I)));
+
+  return result;
+}
+
+template <int I, class C>
+inline std::enable_if_t<
+  is_std_tuple<std::decay_t<C>>{} &&
+  !is_nc_reference<C>{},
+  std::decay_t<C>
+>
+get(lua_State* const L) noexcept(
+  noexcept(get_tuple_arg<std::decay_t<C>>(L, I,
+      std::make_index_sequence<
+        std::size_t(std::tuple_size<std::decay_t<C>>{})
+      >()
+    )
+  )
+)
+{
+  assert(lua_istable(L, I));
+
+  using result_type = std::decay_t<C>;
+
+  return get_tuple_arg<result_type>(L, lua_absindex(L, I),
+    std::make_index_sequence<std::tuple_size<result_type>{}>()
+  );
+}
+
+template<int I, class C>
+inline std::enable_if_t<
+  is_std_array<std::decay_t<C>>{} &&
+  !is_nc_reference<C>{},
+  std::decay_t<C>
+>
+get(lua_State* const L)
+{
+  assert(lua_istable(L, I));
+  auto const t(lua_absindex(L, I));
+
+  using result_type = std::decay_t<C>;
+  auto result(make_container<result_type>(L));
+
+  auto const len(std::min(lua_rawlen(L, t), lua_Unsigned(result.size())));
+
+  for (decltype(lua_rawlen(L, t)) i{}; i != len; ++i)
+  {
+    lua_rawgeti(L, t, i + 1);
+
+    result[i] = get<-1, typename result_type::value_type>(L);
+
+    lua_pop(L, 1);
+  }
+
+  return result;
+}
+
+template <int I, class C>
+inline std::enable_if_t<
+  (is_std_deque<std::decay_t<C>>{} ||
+  is_std_forward_list<std::decay_t<C>>{} ||
+  is_std_list<std::decay_t<C>>{}) &&
+  !is_nc_reference<C>{},
+  std::decay_t<C>
+>
+get(lua_State* const L)
+{
+  assert(lua_istable(L, I));
+  auto const t(lua_absindex(L, I));
+
+  using result_type = std::decay_t<C>;
+  auto result(make_container<result_type>(L));
+
+  for (auto i(lua_rawlen(L, t)); i; --i)
+  {
+    lua_rawgeti(L, t, i);
+
+    result.emplace_front(get<-1, typename result_type::value_type>(L));
+
+    lua_pop(L, 1);
+  }
+
+  return result;
+}
+
+template <int I, class C>
+inline std::enable_if_t<
+  is_std_vector<std::decay_t<C>>{} &&
+  !is_numeric_vector<std::decay_t<C>>{} &&
+  !is_nc_reference<C>{},
+  std::decay_t<C>
+>
+get(lua_State* const L)
+{
+  assert(lua_istable(L, I));
+  auto const t(lua_absindex(L, I));
+
+  using result_type = std::decay_t<C>;
+  auto result(make_container<result_type>(L));
+
+  auto const cend(lua_rawlen(L, t) + 1);
+
+  result.reserve(cend - 1);
+
+  for (decltype(lua_rawlen(L, t)) i(1); i != cend; ++i)
+  {
+    lua_rawgeti(L, t, i);
+
+    result.emplace_back(get<-1, typename result_type::value_type>(L));
+
+    lua_pop(L, 1);
+  }
+
+  return result;
+}
+
+// the elements are pushed a block at a time and converted in a tight loop
+template <int I, class C>
+inline std::enable_if_t<
+  is_numeric_vector<std::decay_t<C>>{} &&
+  !is_nc_reference<C>{},
+  std::decay_t<C>
+>
+get(lua_State* const L)
+{
+  assert(lua_istable(L, I));
+  auto const t(lua_absindex(L, I));
+
+  using result_type = std::decay_t<C>;
+  using value_type = typename result_type::value_type;
+
+  auto result(make_container<result_type>(L));
+
+  result.resize(lua_rawlen(L, t));
+
+  auto const n(result.size());
+
+  auto const b(lua_checkstack(L, numeric_block) ? numeric_block : 1);
+
+  auto p(result.data());
+
+  for (std::size_t i{}; i != n;)
+  {
+    auto const k(int(std::min(n - i, std::size_t(b))));
+
+    for (int j{}; j != k; ++j)
+    {
+      lua_rawgeti(L, t, lua_Integer(++i));
+    }
+
+    for (int j(-k); j; ++j)
+    {
+      assert(lua_isnumber(L, j));
+      *p++ = std::is_floating_point<value_type>{} ?
+        value_type(lua_tonumber(L, j)) :
+        value_type(lua_tointeger(L, j));
+    }
+
+    lua_pop(L, k);
+  }
+
+  return result;
+}
+
+template <int I, class C>
+inline std::enable_if_t<
+  (is_std_map<std::decay_t<C>>{} ||
+  is_std_unordered_map<std::decay_t<C>>{}) &&
+  !is_nc_reference<C>{},
+  std::decay_t<C>
+>
+get(lua_State* const L)
+{
+  assert(lua_istable(L, I));
+  auto const t(lua_absindex(L, I));
+
+  using result_type = std::decay_t<C>;
+  auto result(make_container<result_type>(L));
+
+  reserve_table(L, t, result);
+
+  lua_pushnil(L);
+
+  while (lua_next(L, t))
+  {
+    // lua_tolstring() would convert a number key in place, confusing
+    // lua_next(), so a copy is converted instead
+    auto const copy(is_std_string<typename result_type::key_type>{} &&
+      (LUA_TSTRING != lua_type(L, -2)));
+
+    if (copy)
+    {
+      lua_pushvalue(L, -2);
+      lua_insert(L, -2);
+    }
+    // else do nothing
+
+    result.emplace(get<-2, typename result_type::key_type>(L),
+      get<-1, typename result_type::mapped_type>(L)
+    );
+
+    lua_pop(L, 1 + copy);
+  }
+
+  return result;
+}
+
+template <int I, class C>
+inline std::enable_if_t<
+  (is_std_set<std::decay_t<C>>{} ||
+  is_std_unordered_set<std::decay_t<C>>{}) &&
+  !is_nc_reference<C>{},
+  std::decay_t<C>
+>
+get(lua_State* const L)
+{
+  assert(lua_istable(L, I));
+  auto const t(lua_absindex(L, I));
+
+  using result_type = std::decay_t<C>;
+  using value_type = typename result_type::value_type;
+
+  auto result(make_container<result_type>(L));
+
+  reserve_table(L, t, result);
+
+  lua_pushnil(L);
+
+  while (lua_next(L, t))
+  {
+    if (!std::is_same<value_type, bool>{} &&
+      lua_isboolean(L, -1) && lua_toboolean(L, -1))
+    {
+      lua_pushvalue(L, -2);
+
+      result.emplace(get<-1, value_type>(L));
+
+      lua_pop(L, 1);
+    }
+    else if (lua_isinteger(L, -2))
+    {
+      result.emplace(get<-1, value_type>(L));
+    }
+    // else do nothing
+
+    lua_pop(L, 1);
+  }
+
+  return result;
+}
+
+// anything with has_value(), value() and error(), std::expected for example
+template <typename T, typename = void>
+struct is_expected_like : std::false_type { };
+
+template <typename T>
+struct is_expected_like<T,
+  decltype(
+    void(std::declval<T const&>().has_value()),
+    void(std::declval<T const&>().error()),
+    void(std::declval<typename T::value_type*>())
+  )
+> : std::true_type { };
+
+// value on success, nil, error on failure
+template <typename C>
+inline std::enable_if_t<
+  is_expected_like<std::decay_t<C>>{} &&
+  !std::is_void<typename std::decay_t<C>::value_type>{} &&
+  !is_nc_reference<C>{},
+  int
+>
+set(lua_State* const L, C&& e)
+{
+  auto const& c(e);
+
+  if (c.has_value())
+  {
+    return set(L, *c);
+  }
+  else
+  {
+    lua_pushnil(L);
+
+    return 1 + set(L, c.error());
+  }
+}
+
+// true on success, nil, error on failure
+template <typename C>
+inline std::enable_if_t<
+  is_expected_like<std::decay_t<C>>{} &&
+  std::is_void<typename std::decay_t<C>::value_type>{} &&
+  !is_nc_reference<C>{},
+  int
+>
+set(lua_State* const L, C&& e)
+{
+  auto const& c(e);
+
+  if (c.has_value())
+  {
+    lua_pushboolean(L, true);
+
+    return 1;
+  }
+  else
+  {
+    lua_pushnil(L);
+
+    return 1 + set(L, c.error());
+  }
+}
+
+#if __cplusplus >= 201703L
+
+template <typename>
+struct is_std_optional : std::false_type { };
+
+template <typename T>
+struct is_std_optional<std::optional<T> > : std::true_type { };
+
+template <typename C>
+inline std::enable_if_t<
+  is_std_optional<std::decay_t<C>>{} &&
+  !is_nc_reference<C>{},
+  int
+>
+set(lua_State* const L, C&& o)
+{
+  auto const& c(o);
+
+  if (c)
+  {
+    return set(L, *c);
+  }
+  else
+  {
+    lua_pushnil(L);
+
+    return 1;
+  }
+}
+
+template <int I, class C>
+inline std::enable_if_t<
+  is_std_optional<std::decay_t<C>>{} &&
+  !is_nc_reference<C>{},
+  std::decay_t<C>
+>
+get(lua_State* const L)
+{
+  using result_type = std::decay_t<C>;
+
+  return lua_isnoneornil(L, I) ?
+    result_type() :
+    result_type(get<I, typename result_type::value_type>(L));
+}
+
+#endif // __cplusplus
+
+#endif // LUALITE_NO_STD_CONTAINERS
+
+// a field of a struct_, see below
+template <typename T, typename M>
+struct field_info
+{
+  char const* const name;
+
+  M T::* const ptr;
+};
+
+template <typename T, typename M>
+constexpr auto field(char const* const name, M T::* const ptr) noexcept
+{
+  return field_info<T, M>{name, ptr};
+}
+
+// specialize with a static constexpr fields() function, returning a
+// std::tuple of field()s, to pass T as a table with these fields
+template <typename T>
+struct struct_
+{
+};
+
+template <typename T, typename = void>
+struct is_struct : std::false_type { };
+
+template <typename T>
+struct is_struct<T, decltype(void(struct_<T>::fields()))> : std::true_type
+{
+};
+
+template <typename T>
+struct lua_type_of<T,
+  std::enable_if_t<
+    is_struct<std::decay_t<T>>{} &&
+    !is_nc_reference<T>{}
+  >
+> : std::integral_constant<int, LUA_TTABLE> { };
+
+template <typename T>
+inline std::enable_if_t<
+  is_struct<std::decay_t<T>>{} &&
+  !is_nc_reference<T>{},
+  int
+>
+set(lua_State*, T&&);
+
+template <int I, typename T>
+inline std::enable_if_t<
+  is_struct<std::decay_t<T>>{} &&
+  !is_nc_reference<T>{},
+  std::decay_t<T>
+>
+get(lua_State*);
+
+template <typename T>
+inline void const* struct_key() noexcept
+{
+  static char const k{};
+
+  return &k;
+}
+
+template <typename F, std::size_t ...I>
+inline void push_names(lua_State* const L, F const& f,
+  std::index_sequence<I...> const) noexcept
+{
+  swallow{
+    (lua_pushstring(L, std::get<I>(f).name), lua_rawseti(L, -2, I + 1), 0)...
+  };
+}
+
+// the field names of T are interned once per state, in the registry
+template <typename T>
+inline void push_struct_keys(lua_State* const L)
+{
+  if (LUA_TTABLE != lua_rawgetp(L, LUA_REGISTRYINDEX, struct_key<T>()))
+  {
+    lua_pop(L, 1);
+
+    constexpr auto const f(struct_<T>::fields());
+
+    constexpr auto const n(std::tuple_size<std::decay_t<decltype(f)>>{});
+
+    lua_createtable(L, n, 0);
+
+    push_names(L, f, std::make_index_sequence<n>());
+
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, struct_key<T>());
+  }
+  // else do nothing
+}
+
+// the keys are at the top, the table below them
+template <typename T, typename M>
+inline void set_field(lua_State* const L, int const k, T const& v,
+  field_info<T, M> const& f)
+{
+  lua_rawgeti(L, -1, k);
+  set(L, static_cast<M const&>(v.*f.ptr));
+  lua_rawset(L, -4);
+}
+
+template <typename T, typename F, std::size_t ...I>
+inline void set_fields(lua_State* const L, T const& v, F const& f,
+  std::index_sequence<I...> const)
+{
+  swallow{(set_field(L, I + 1, v, std::get<I>(f)), 0)...};
+}
+
+template <typename T>
+inline std::enable_if_t<
+  is_struct<std::decay_t<T>>{} &&
+  !is_nc_reference<T>{},
+  int
+>
+set(lua_State* const L, T&& v)
+{
+  using type = std::decay_t<T>;
+
+  constexpr auto const f(struct_<type>::fields());
+
+  constexpr auto const n(std::tuple_size<std::decay_t<decltype(f)>>{});
+
+  lua_createtable(L, 0, n);
+
+  push_struct_keys<type>(L);
+
+  set_fields(L, static_cast<type const&>(v), f, std::make_index_sequence<n>());
+
+  lua_pop(L, 1);
+
+  return 1;
+}
+
+// absent fields are left alone
+template <typename T, typename M>
+inline void get_field(lua_State* const L, int const i, int const k, T& v,
+  field_info<T, M> const& f)
+{
+  lua_rawgeti(L, -1, k);
+  lua_rawget(L, i);
+
+  if (!lua_isnil(L, -1))
+  {
+    v.*f.ptr = get<-1, M>(L);
+  }
+  // else do nothing
+
+  lua_pop(L, 1);
+}
+
+template <typename T, typename F, std::size_t ...I>
+inline void get_fields(lua_State* const L, int const i, T& v, F const& f,
+  std::index_sequence<I...> const)
+{
+  swallow{(get_field(L, i, I + 1, v, std::get<I>(f)), 0)...};
+}
+
+template <int I, typename T>
+inline std::enable_if_t<
+  is_struct<std::decay_t<T>>{} &&
+  !is_nc_reference<T>{},
+  std::decay_t<T>
+>
+get(lua_State* const L)
+{
+  using type = std::decay_t<T>;
+
+  assert(lua_istable(L, I));
+  auto const i(lua_absindex(L, I));
+
+  constexpr auto const f(struct_<type>::fields());
+
+  push_struct_keys<type>(L);
+
+  type v{};
+
+  get_fields(L, i, v, f,
+    std::make_index_sequence<std::tuple_size<std::decay_t<decltype(f)>>{}>());
+
+  lua_pop(L, 1);
+
+  return v;
+}
+
+// the function is below the arguments, any error is thrown as lualite::error
+template <typename ...A>
+inline void pcall(lua_State* const L, int const nresults, A&& ...args)
+{
+  int const n[]{0, set(L, std::forward<A>(args))...};
+
+  int ac{};
+
+  for (auto const i: n)
+  {
+    ac += i;
+  }
+
+  assert(ac >= int(sizeof...(A)));
+
+  if (lua_pcall(L, ac, nresults, 0))
+  {
+    error e(lua_isstring(L, -1) ? lua_tostring(L, -1) : "lua error");
+
+    lua_pop(L, 1);
+
+    throw e;
+  }
+  // else do nothing
+}
+
+template <typename R, typename ...A>
+inline std::enable_if_t<std::is_void<R>{}, R>
+pcall_result(lua_State* const L, A&& ...args)
+{
+  pcall(L, 0, std::forward<A>(args)...);
+}
+
+template <typename R, typename ...A>
+inline std::enable_if_t<!std::is_void<R>{}, R>
+pcall_result(lua_State* const L, A&& ...args)
+{
+  static_assert(!std::is_same<std::decay_t<R>, char const*>{},
+    "the result is popped, char const* would dangle");
+
+  pcall(L, 1, std::forward<A>(args)...);
+
+  auto const se(make_scope_exit([L]() noexcept { lua_pop(L, 1); }));
+
+  return get<-1, R>(L);
+}
+
+// refers to a lua function on the stack, valid only as long as the
+// stack slot is, for example, for the duration of a stub call
+template <typename> class function_ref;
+
+template <typename R, typename ...A>
+class function_ref<R(A...)>
+{
+  lua_State* L_;
+
+  int index_;
+
+public:
+  function_ref(lua_State* const L, int const index) noexcept :
+    L_(L),
+    index_(lua_absindex(L, index))
+  {
+    assert(lua_isfunction(L, index_));
+  }
+
+  R operator()(A... args) const
+  {
+    lua_pushvalue(L_, index_);
+
+    return pcall_result<R>(L_, std::forward<A>(args)...);
+  }
+};
+
+template <typename>
+struct is_function_ref : std::false_type { };
+
+template <typename F>
+struct is_function_ref<function_ref<F> > : std::true_type { };
+
+template <int I, typename T>
+inline std::enable_if_t<
+  is_function_ref<std::decay_t<T>>{} &&
+  !is_nc_reference<T>{},
+  std::decay_t<T>
+>
+get(lua_State* const L) noexcept
+{
+  return {L, I};
+}
+
+template <typename T>
+struct lua_type_of<T,
+  std::enable_if_t<
+    is_function_ref<std::decay_t<T>>{} &&
+    !is_nc_reference<T>{}
+  >
+> : std::integral_constant<int, LUA_TFUNCTION> { };
+
+#ifndef LUALITE_NO_STD_CONTAINERS
+
+// a registry reference to a lua function, called on the main thread
+class function_handle
+{
+  lua_State* L_;
+
+  int ref_;
+
+public:
+  function_handle(lua_State* const L, int const index)
+  {
+    assert(lua_isfunction(L, index));
+    lua_pushvalue(L, index);
+    ref_ = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+    L_ = lua_tothread(L, -1);
+    lua_pop(L, 1);
+  }
+
+  function_handle(function_handle const&) = delete;
+
+  function_handle& operator=(function_handle const&) = delete;
+
+  ~function_handle() noexcept { luaL_unref(L_, LUA_REGISTRYINDEX, ref_); }
+
+  template <typename R, typename ...A>
+  R call(A&& ...args) const
+  {
+    lua_rawgeti(L_, LUA_REGISTRYINDEX, ref_);
+
+    return pcall_result<R>(L_, std::forward<A>(args)...);
+  }
+};
+
+template <typename>
+struct is_std_function : std::false_type { };
+
+template <typename R, typename ...A>
+struct is_std_function<std::function<R(A...)> > : std::true_type { };
+
+template <typename R, typename ...A>
+inline std::function<R(A...)>
+make_function(lua_State* const L, int const index,
+  std::function<R(A...)> const*)
+{
+  auto const h(std::make_shared<function_handle const>(L, index));
+
+  return [h](A... args) -> R {
+      return h->template call<R>(std::forward<A>(args)...);
+    };
+}
+
+// the function outlives the call, the lua state must outlive the function
+template <int I, typename T>
+inline std::enable_if_t<
+  is_std_function<std::decay_t<T>>{} &&
+  !is_nc_reference<T>{},
+  std::decay_t<T>
+>
+get(lua_State* const L)
+{
+  return make_function(L, I, static_cast<std::decay_t<T> const*>(nullptr));
+}
+
+template <typename T>
+struct lua_type_of<T,
+  std::enable_if_t<
+    is_std_function<std::decay_t<T>>{} &&
+    !is_nc_reference<T>{}
+  >
+> : std::integral_constant<int, LUA_TFUNCTION> { };
+
+#endif // LUALITE_NO_STD_CONTAINERS
+
+template <typename F>
+struct is_nothrow_callable :
+  std::integral_constant<bool, noexcept(std::declval<F const&>()())>
+{
+};
+
+// while a profiler is attached to any state, see profiler.hpp, stubs call
+// the hook with a level of 1, when they are entered, and of 0, when they
+// return
+inline auto& stub_hook() noexcept
+{
+  static std::atomic<void (*)(lua_State*, int)> h{};
+
+  return h;
+}
+
+template <typename F>
+inline int observe(lua_State* const L, F const& f) noexcept(noexcept(f()))
+{
+#ifndef LUALITE_NO_PROFILER
+  if (auto const h = stub_hook().load(std::memory_order_relaxed))
+  {
+    h(L, 1);
+
+    auto const r(f());
+
+    h(L, 0);
+
+    return r;
+  }
+  // else do nothing
+#else
+  static_cast<void>(L);
+#endif // LUALITE_NO_PROFILER
+
+  return f();
+}
+
+template <typename F>
+inline std::enable_if_t<is_nothrow_callable<F>{}, int>
+exception_barrier(lua_State* const L, F const& f) noexcept
+{
+  return observe(L, f);
+}
+
+inline int push_message_stub(lua_State* const L)
+{
+  lua_pushstring(L, static_cast<char const*>(lua_touserdata(L, 1)));
+
+  return 1;
+}
+
+// pushes the message, or, if it can't be allocated, the memory error
+// message, without raising an error
+inline void push_message(lua_State* const L, char const* const m) noexcept
+{
+  lua_pushcfunction(L, push_message_stub);
+  lua_pushlightuserdata(L, const_cast<char*>(m));
+
+  lua_pcall(L, 1, 1, 0);
+}
+
+// the exception is destroyed before lua_error() unwinds the lua frames, no
+// error is raised while it is handled; define LUALITE_NO_CATCH_ALL, if lua
+// is compiled as C++ and raises errors by throwing
+template <typename F>
+inline std::enable_if_t<!is_nothrow_callable<F>{}, int>
+exception_barrier(lua_State* const L, F const& f)
+{
+  try
+  {
+    return observe(L, f);
+  }
+  catch (std::exception const& e)
+  {
+    push_message(L, e.what());
+  }
+#ifndef LUALITE_NO_CATCH_ALL
+  catch (...)
+  {
+    push_message(L, "unknown C++ exception");
+  }
+#endif // LUALITE_NO_CATCH_ALL
+
+  return lua_error(L);
+}
+
+// the metatable of proxies of a type is kept in the registry
+template <typename T>
+inline void const* proxy_key() noexcept
+{
+  static char const k{};
+
+  return &k;
+}
+
+// a pair of iterators, or an iterator and a sentinel, returned to lua as a
+// generic for iterator, that converts one element per step; the elements
+// must outlive the loop, an element converted to nil ends it
+template <typename I, typename S = I>
+struct iterator_range
+{
+  I first;
+  S last;
+};
+
+template <typename I, typename S>
+inline auto range(I first, S last)
+{
+  return iterator_range<I, S>{std::move(first), std::move(last)};
+}
+
+template <typename C>
+inline auto range(C& c)
+{
+  using std::begin;
+  using std::end;
+
+  return range(begin(c), end(c));
+}
+
+// f is called once per step and returns a pointer, or an optional-like
+// value, to the next element, or an empty one to end the loop
+template <typename F>
+struct generator_range
+{
+  F f;
+};
+
+template <typename F>
+inline auto generator(F f)
+{
+  return generator_range<F>{std::move(f)};
+}
+
+template <typename>
+struct is_iterator_range : std::false_type { };
+
+template <typename I, typename S>
+struct is_iterator_range<iterator_range<I, S> > : std::true_type { };
+
+template <typename F>
+struct is_iterator_range<generator_range<F> > : std::true_type { };
+
+// pairs are iterated as keys and values, as with pairs()
+template <typename T>
+inline int push_element(lua_State* const L, T const& v)
+{
+  return set(L, v);
+}
+
+template <typename A, typename B>
+inline int push_element(lua_State* const L, std::pair<A, B> const& v)
+{
+  return set(L, v.first) + set(L, v.second);
+}
+
+template <typename I, typename S>
+inline int next_element(lua_State* const L, iterator_range<I, S>& r)
+{
+  if (r.first == r.last)
+  {
+    return 0;
+  }
+  else
+  {
+    auto const n(push_element(L, *r.first));
+
+    ++r.first;
+
+    return n;
+  }
+}
+
+template <typename F>
+inline int next_element(lua_State* const L, generator_range<F>& r)
+{
+  auto&& v(r.f());
+
+  return v ? push_element(L, *v) : 0;
+}
+
+// the userdata holding the range is upvalue 1, the arguments of the call
+// are ignored
+template <typename R>
+int range_next(lua_State* const L)
+{
+  auto& r(*static_cast<R*>(lua_touserdata(L, lua_upvalueindex(1))));
+
+  return exception_barrier(L, [&]() { return next_element(L, r); });
+}
+
+template <typename R>
+int range_gc(lua_State* const L) noexcept
+{
+  static_cast<R*>(lua_touserdata(L, 1))->~R();
+
+  return {};
+}
+
+template <typename T>
+inline std::enable_if_t<
+  is_iterator_range<std::decay_t<T>>{} &&
+  !is_nc_reference<T>{},
+  int
+>
+set(lua_State* const L, T&& r)
+{
+  using type = std::decay_t<T>;
+
+  new (lua_newuserdata(L, sizeof(type))) type(std::forward<T>(r));
+
+  if (!std::is_trivially_destructible<type>{})
+  {
+    if (LUA_TTABLE != lua_rawgetp(L, LUA_REGISTRYINDEX, proxy_key<type>()))
+    {
+      lua_pop(L, 1);
+
+      lua_createtable(L, 0, 1);
+
+      lua_pushcfunction(L, range_gc<type>);
+      rawsetfield(L, -2, "__gc");
+
+      lua_pushvalue(L, -1);
+      lua_rawsetp(L, LUA_REGISTRYINDEX, proxy_key<type>());
+    }
+    // else do nothing
+
+    lua_setmetatable(L, -2);
+  }
+  // else do nothing
+
+  lua_pushcclosure(L, range_next<type>, 1);
+
+  return 1;
+}
+
+#ifndef LUALITE_NO_STD_CONTAINERS
+
+// immutable data, shared by any number of states; lua sees it through
+// read-only proxies, that refer into it, elements are pushed on access
+template <typename T>
+class shared
+{
+  std::shared_ptr<T const> p_;
+
+public:
+  shared(std::shared_ptr<T const> p) noexcept : p_(std::move(p)) { }
+
+  auto const& get() const noexcept { return p_; }
+};
+
+template <typename>
+struct is_shared : std::false_type { };
+
+template <typename T>
+struct is_shared<shared<T> > : std::true_type { };
+
+// a proxy keeps the shared data alive
+template <typename T>
+struct proxy
+{
+  std::shared_ptr<void const> const owner;
+
+  T const* const p;
+};
+
+template <typename T>
+using is_proxied_sequence =
+  std::integral_constant<bool,
+    is_std_array<T>{} ||
+    is_std_deque<T>{} ||
+    is_std_vector<T>{}
+  >;
+
+template <typename T>
+using is_proxied_map =
+  std::integral_constant<bool,
+    is_std_map<T>{} ||
+    is_std_unordered_map<T>{}
+  >;
+
+template <typename T>
+using is_proxied_set =
+  std::integral_constant<bool,
+    is_std_set<T>{} ||
+    is_std_unordered_set<T>{}
+  >;
+
+// objects are accessed through the const getters of their class_
+template <typename T>
+using is_proxied_object =
+  std::integral_constant<bool,
+    std::is_class<T>{} &&
+    !is_proxied_sequence<T>{} &&
+    !is_proxied_map<T>{} &&
+    !is_proxied_set<T>{} &&
+    !std::is_same<T, std::string>{} &&
+    !is_std_forward_list<T>{} &&
+    !is_std_list<T>{} &&
+    !is_std_pair<T>{} &&
+    !is_std_tuple<T>{}
+  >;
+
+template <typename T>
+using is_proxied =
+  std::integral_constant<bool,
+    is_proxied_sequence<T>{} ||
+    is_proxied_map<T>{} ||
+    is_proxied_set<T>{} ||
+    is_proxied_object<T>{}
+  >;
+
+template <typename T>
+void push_proxy(lua_State*, std::shared_ptr<void const> const&, T const*);
+
+template <typename T>
+inline std::enable_if_t<!is_proxied<T>{}>
+push_element(lua_State* const L, std::shared_ptr<void const> const&,
+  T const& v)
+{
+  set(L, v);
+}
+
+template <typename T>
+inline std::enable_if_t<is_proxied<T>{}>
+push_element(lua_State* const L, std::shared_ptr<void const> const& owner,
+  T const& v)
+{
+  push_proxy(L, owner, &v);
+}
+
+template <typename T>
+inline auto& to_proxy(lua_State* const L) noexcept
+{
+  return *static_cast<proxy<T> const*>(lua_touserdata(L, 1));
+}
+
+template <typename T>
+inline std::enable_if_t<
+  !std::is_integral<T>{} || std::is_same<T, bool>{},
+  bool
+>
+is_key(lua_State* const L) noexcept
+{
+  return (LUA_TNONE == lua_type_of<T>{}) ||
+    (lua_type_of<T>{} == lua_type(L, 2));
+}
+
+// integer keys must be representable as T
+template <typename T>
+inline std::enable_if_t<
+  std::is_integral<T>{} && std::is_signed<T>{},
+  bool
+>
+is_key(lua_State* const L) noexcept
+{
+  int isnum{};
+
+  auto const i(LUA_TNUMBER == lua_type(L, 2) ?
+    lua_tointegerx(L, 2, &isnum) : 0);
+
+  return isnum &&
+    (i >= lua_Integer(std::numeric_limits<T>::min())) &&
+    (i <= lua_Integer(std::numeric_limits<T>::max()));
+}
+
+template <typename T>
+inline std::enable_if_t<
+  std::is_integral<T>{} &&
+  std::is_unsigned<T>{} &&
+  !std::is_same<T, bool>{},
+  bool
+>
+is_key(lua_State* const L) noexcept
+{
+  int isnum{};
+
+  auto const i(LUA_TNUMBER == lua_type(L, 2) ?
+    lua_tointegerx(L, 2, &isnum) : 0);
+
+  return isnum && (i >= 0) &&
+    (lua_Unsigned(i) <= std::numeric_limits<T>::max());
+}
+
+template <typename T>
+int proxy_gc(lua_State* const L) noexcept
+{
+  static_cast<proxy<T>*>(lua_touserdata(L, 1))->~proxy();
+
+  return {};
+}
+
+inline int proxy_newindex(lua_State* const L)
+{
+  return luaL_error(L, "attempt to modify shared data");
+}
+
+template <typename T>
+inline std::enable_if_t<is_proxied_sequence<T>{}, int>
+proxy_index(lua_State* const L)
+{
+  auto const& x(to_proxy<T>(L));
+
+  int isnum;
+
+  auto const i(lua_tointegerx(L, 2, &isnum));
+
+  if (isnum && (i >= 1) && (lua_Unsigned(i) <= x.p->size()))
+  {
+    push_element(L, x.owner, (*x.p)[i - 1]);
+  }
+  else
+  {
+    lua_pushnil(L);
+  }
+
+  return 1;
+}
+
+template <typename T>
+inline std::enable_if_t<is_proxied_map<T>{}, int>
+proxy_index(lua_State* const L)
+{
+  return exception_barrier(L, [L]() {
+      auto const& x(to_proxy<T>(L));
+
+      using key_type = typename T::key_type;
+
+      if (is_key<key_type>(L))
+      {
+        auto const i(x.p->find(get<2, key_type>(L)));
+
+        if (x.p->cend() != i)
+        {
+          push_element(L, x.owner, i->second);
+
+          return 1;
+        }
+        // else do nothing
+      }
+      // else do nothing
+
+      lua_pushnil(L);
+
+      return 1;
+    }
+  );
+}
+
+template <typename T>
+inline std::enable_if_t<is_proxied_set<T>{}, int>
+proxy_index(lua_State* const L)
+{
+  return exception_barrier(L, [L]() {
+      auto const& x(to_proxy<T>(L));
+
+      using key_type = typename T::key_type;
+
+      if (is_key<key_type>(L) && x.p->count(get<2, key_type>(L)))
+      {
+        lua_pushboolean(L, true);
+      }
+      else
+      {
+        lua_pushnil(L);
+      }
+
+      return 1;
+    }
+  );
+}
+
+template <typename T>
+inline std::enable_if_t<is_proxied_object<T>{}, int>
+proxy_index(lua_State* const L)
+{
+  if (LUA_TSTRING == lua_type(L, 2))
+  {
+    if (auto const a = find_const_getter<T>(lua_tostring(L, 2)))
+    {
+      // only const member functions are called on p
+      void* p(const_cast<T*>(to_proxy<T>(L).p));
+
+      for (auto const f: std::get<0>(*a))
+      {
+        p = f(p);
+      }
+
+      // the getter expects the object in upvalue 2
+      lua_pushnil(L);
+      lua_pushlightuserdata(L, p);
+      lua_pushcclosure(L, std::get<1>(*a), 2);
+
+      lua_insert(L, 1);
+      lua_call(L, 2, 1);
+
+      return 1;
+    }
+    // else do nothing
+  }
+  // else do nothing
+
+  lua_pushnil(L);
+
+  return 1;
+}
+
+template <typename T>
+int proxy_len(lua_State* const L) noexcept
+{
+  lua_pushinteger(L, to_proxy<T>(L).p->size());
+
+  return 1;
+}
+
+template <typename T, typename I>
+inline std::enable_if_t<is_proxied_sequence<T>{}>
+push_pair(lua_State* const L, proxy<T> const& x, I const i)
+{
+  lua_pushinteger(L, i - x.p->cbegin() + 1);
+  push_element(L, x.owner, *i);
+}
+
+template <typename T, typename I>
+inline std::enable_if_t<is_proxied_map<T>{}>
+push_pair(lua_State* const L, proxy<T> const& x, I const i)
+{
+  set(L, i->first);
+  push_element(L, x.owner, i->second);
+}
+
+template <typename T, typename I>
+inline std::enable_if_t<is_proxied_set<T>{}>
+push_pair(lua_State* const L, proxy<T> const&, I const i)
+{
+  set(L, *i);
+  lua_pushboolean(L, true);
+}
+
+// the iterator is in upvalue 1, the proxy is the state of the loop
+template <typename T>
+int proxy_next(lua_State* const L)
+{
+  return exception_barrier(L, [L]() {
+      auto& i(*static_cast<typename T::const_iterator*>(
+        lua_touserdata(L, lua_upvalueindex(1))));
+
+      auto const& x(to_proxy<T>(L));
+
+      if (x.p->cend() == i)
+      {
+        return 0;
+      }
+      else
+      {
+        push_pair(L, x, i++);
+
+        return 2;
+      }
+    }
+  );
+}
+
+template <typename T>
+int proxy_pairs(lua_State* const L)
+{
+  using iterator = typename T::const_iterator;
+
+  static_assert(std::is_trivially_destructible<iterator>{},
+    "the iterator is not finalized");
+
+  new (lua_newuserdata(L, sizeof(iterator))) iterator(
+    to_proxy<T>(L).p->cbegin());
+
+  lua_pushcclosure(L, proxy_next<T>, 1);
+  lua_pushvalue(L, 1);
+  lua_pushnil(L);
+
+  return 3;
+}
+
+template <typename T>
+inline std::enable_if_t<is_proxied_object<T>{}>
+set_container_metamethods(lua_State* const) noexcept
+{
+}
+
+template <typename T>
+inline std::enable_if_t<!is_proxied_object<T>{}>
+set_container_metamethods(lua_State* const L) noexcept
+{
+  lua_pushcfunction(L, proxy_len<T>);
+  rawsetfield(L, -2, "__len");
+
+  lua_pushcfunction(L, proxy_pairs<T>);
+  rawsetfield(L, -2, "__pairs");
+}
+
+template <typename T>
+inline void push_proxy(lua_State* const L,
+  std::shared_ptr<void const> const& owner, T const* const p)
+{
+  new (lua_newuserdata(L, sizeof(proxy<T>))) proxy<T>{owner, p};
+
+  if (LUA_TTABLE != lua_rawgetp(L, LUA_REGISTRYINDEX, proxy_key<T>()))
+  {
+    lua_pop(L, 1);
+
+    lua_createtable(L, 0, 5);
+
+    lua_pushcfunction(L, proxy_gc<T>);
+    rawsetfield(L, -2, "__gc");
+
+    lua_pushcfunction(L, proxy_index<T>);
+    rawsetfield(L, -2, "__index");
+
+    lua_pushcfunction(L, proxy_newindex);
+    rawsetfield(L, -2, "__newindex");
+
+    set_container_metamethods<T>(L);
+
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, proxy_key<T>());
+  }
+  // else do nothing
+
+  lua_setmetatable(L, -2);
+}
+
+template <typename T>
+inline std::enable_if_t<
+  is_shared<std::decay_t<T>>{} &&
+  !is_nc_reference<T>{},
+  int
+>
+set(lua_State* const L, T&& v)
+{
+  push_proxy(L, v.get(), v.get().get());
+
+  return 1;
+}
+
+template <typename T>
+struct lua_type_of<T,
+  std::enable_if_t<
+    is_shared<std::decay_t<T>>{} &&
+    !is_nc_reference<T>{}
+  >
+> : std::integral_constant<int, LUA_TUSERDATA> { };
+
+#endif // LUALITE_NO_STD_CONTAINERS
+
+// exposes a std::vector of a struct_ to lua without copying it; ps[i].x
+// reads and ps[i].x = v writes the vector directly through a small cursor
+// of element i, created on first access and kept by the columns,
+// ps:get(i, "x") and ps:set(i, "x", v) do the same without any; the vector
+// must outlive its columns and its cursors
+template <typename T>
+class columns
+{
+  std::vector<T>* v_;
+
+public:
+  explicit columns(std::vector<T>& v) noexcept : v_(&v) { }
+
+  auto get() const noexcept { return v_; }
+};
+
+template <typename>
+struct is_columns : std::false_type { };
+
+template <typename T>
+struct is_columns<columns<T> > : std::true_type { };
+
+template <typename T>
+struct cursor
+{
+  std::vector<T>* const v;
+
+  lua_Integer const i;
+};
+
+template <typename T, std::size_t I>
+constexpr auto field_ptr() noexcept
+{
+  return std::get<I>(struct_<T>::fields()).ptr;
+}
+
+template <typename T, std::size_t I>
+using field_type =
+  std::decay_t<decltype(std::declval<T&>().*field_ptr<T, I>())>;
+
+// the operations on a field, with elements and whole columns
+template <typename T>
+struct column_ops
+{
+  void (*push)(lua_State*, T const&);
+  void (*assign)(lua_State*, T&);
+
+  void (*read)(lua_State*, std::vector<T> const&, int);
+  void (*write)(lua_State*, std::vector<T>&, int);
+  void (*fill)(lua_State*, std::vector<T>&);
+  void (*add)(lua_State*, std::vector<T>&);
+  void (*mul)(lua_State*, std::vector<T>&);
+};
+
+template <typename T, std::size_t I>
+inline void push_field(lua_State* const L, T const& v)
+{
+  set(L, static_cast<field_type<T, I> const&>(v.*field_ptr<T, I>()));
+}
+
+// the value is at the top
+template <typename T, std::size_t I>
+inline void assign_field(lua_State* const L, T& v)
+{
+  v.*field_ptr<T, I>() = get<-1, field_type<T, I> >(L);
+}
+
+template <typename T, std::size_t I>
+inline void read_column(lua_State* const L, std::vector<T> const& v,
+  int const t)
+{
+  lua_Integer j{};
+
+  for (auto& e: v)
+  {
+    push_field<T, I>(L, e);
+
+    lua_rawseti(L, t, ++j);
+  }
+}
+
+template <typename T, std::size_t I>
+inline void write_column(lua_State* const L, std::vector<T>& v, int const t)
+{
+  lua_Integer j{};
+
+  for (auto& e: v)
+  {
+    if (LUA_TNIL != lua_rawgeti(L, t, ++j))
+    {
+      assign_field<T, I>(L, e);
+    }
+    // else do nothing
+
+    lua_pop(L, 1);
+  }
+}
+
+// the value is at the top
+template <typename T, std::size_t I>
+inline void fill_column(lua_State* const L, std::vector<T>& v)
+{
+  auto const x(get<-1, field_type<T, I> >(L));
+
+  for (auto& e: v)
+  {
+    e.*field_ptr<T, I>() = x;
+  }
+}
+
+// the value is at the top, fractions are not truncated silently
+template <typename T, std::size_t I>
+inline auto column_operand(lua_State* const L)
+{
+  using type = field_type<T, I>;
+
+  if (std::is_integral<type>{})
+  {
+    int isnum;
+
+    lua_tointegerx(L, -1, &isnum);
+
+    if (!isnum)
+    {
+      throw error("an integral field needs an integer operand");
+    }
+    // else do nothing
+  }
+  // else do nothing
+
+  return get<-1, type>(L);
+}
+
+template <typename T, std::size_t I>
+inline std::enable_if_t<std::is_arithmetic<field_type<T, I> >{}>
+add_column(lua_State* const L, std::vector<T>& v)
+{
+  auto const x(column_operand<T, I>(L));
+
+  for (auto& e: v)
+  {
+    e.*field_ptr<T, I>() += x;
+  }
+}
+
+template <typename T, std::size_t I>
+inline std::enable_if_t<std::is_arithmetic<field_type<T, I> >{}>
+mul_column(lua_State* const L, std::vector<T>& v)
+{
+  auto const x(column_operand<T, I>(L));
+
+  for (auto& e: v)
+  {
+    e.*field_ptr<T, I>() *= x;
+  }
+}
+
+template <typename T, std::size_t I>
+inline std::enable_if_t<!std::is_arithmetic<field_type<T, I> >{}>
+add_column(lua_State* const, std::vector<T>&)
+{
+  throw error("not a numeric field");
+}
+
+template <typename T, std::size_t I>
+inline std::enable_if_t<!std::is_arithmetic<field_type<T, I> >{}>
+mul_column(lua_State* const, std::vector<T>&)
+{
+  throw error("not a numeric field");
+}
+
+template <typename T, std::size_t ...I>
+inline auto column_ops_of(std::index_sequence<I...> const) noexcept
+{
+  static column_ops<T> const ops[]{
+    {
+      push_field<T, I>,
+      assign_field<T, I>,
+      read_column<T, I>,
+      write_column<T, I>,
+      fill_column<T, I>,
+      add_column<T, I>,
+      mul_column<T, I>
+    }...
+  };
+
+  return ops;
+}
+
+// the field called by the string at index i, upvalue 1 maps field names
+// to field numbers
+template <typename T>
+inline auto& find_column(lua_State* const L, int const i)
+{
+  lua_pushvalue(L, i);
+  lua_rawget(L, lua_upvalueindex(1));
+
+  int isnum;
+
+  auto const k(lua_tointegerx(L, -1, &isnum));
+
+  lua_pop(L, 1);
+
+  if (!isnum)
+  {
+    throw error("no such field");
+  }
+  // else do nothing
+
+  return column_ops_of<T>(std::make_index_sequence<
+    std::tuple_size<decltype(struct_<T>::fields())>{}>())[k - 1];
+}
+
+template <typename T>
+inline T& column_element(std::vector<T>& v, lua_Integer const i)
+{
+  if ((i < 1) || (lua_Unsigned(i) > v.size()))
+  {
+    throw error("element index out of range");
+  }
+  // else do nothing
+
+  return v[i - 1];
+}
+
+template <typename T>
+inline T& cursor_element(lua_State* const L)
+{
+  auto const& c(*static_cast<cursor<T> const*>(lua_touserdata(L, 1)));
+
+  return column_element(*c.v, c.i);
+}
+
+template <typename T>
+int cursor_index(lua_State* const L)
+{
+  return exception_barrier(L, [L]() {
+      find_column<T>(L, 2).push(L, cursor_element<T>(L));
+
+      return 1;
+    }
+  );
+}
+
+template <typename T>
+int cursor_newindex(lua_State* const L)
+{
+  return exception_barrier(L, [L]() {
+      find_column<T>(L, 2).assign(L, cursor_element<T>(L));
+
+      return 0;
+    }
+  );
+}
+
+template <typename T>
+inline auto& columns_vector(lua_State* const L) noexcept
+{
+  return **static_cast<std::vector<T>* const*>(lua_touserdata(L, 1));
+}
+
+// ps:read(name[, t]) returns the column in t or in a new table
+template <typename T>
+int columns_read(lua_State* const L)
+{
+  return exception_barrier(L, [L]() {
+      auto& v(columns_vector<T>(L));
+
+      if (!lua_istable(L, 3))
+      {
+        lua_settop(L, 2);
+        lua_createtable(L, size_hint(v.size()), 0);
+      }
+      // else do nothing
+
+      find_column<T>(L, 2).read(L, v, 3);
+
+      lua_settop(L, 3);
+
+      return 1;
+    }
+  );
+}
+
+// ps:write(name, t) sets the column from t, nils are skipped
+template <typename T>
+int columns_write(lua_State* const L)
+{
+  return exception_barrier(L, [L]() {
+      luaL_checktype(L, 3, LUA_TTABLE);
+
+      find_column<T>(L, 2).write(L, columns_vector<T>(L), 3);
+
+      return 0;
+    }
+  );
+}
+
+// ps:get(i, name)
+template <typename T>
+int columns_get(lua_State* const L)
+{
+  return exception_barrier(L, [L]() {
+      auto const i(luaL_checkinteger(L, 2));
+
+      find_column<T>(L, 3).push(L,
+        column_element(columns_vector<T>(L), i));
+
+      return 1;
+    }
+  );
+}
+
+// ps:set(i, name, v)
+template <typename T>
+int columns_set(lua_State* const L)
+{
+  return exception_barrier(L, [L]() {
+      auto const i(luaL_checkinteger(L, 2));
+
+      lua_settop(L, 4);
+
+      find_column<T>(L, 3).assign(L,
+        column_element(columns_vector<T>(L), i));
+
+      return 0;
+    }
+  );
+}
+
+// ps:fill(name, v), ps:add(name, v) and ps:mul(name, v)
+template <typename T, void (*column_ops<T>::*op)(lua_State*, std::vector<T>&)>
+int columns_apply(lua_State* const L)
+{
+  return exception_barrier(L, [L]() {
+      lua_settop(L, 3);
+
+      (find_column<T>(L, 2).*op)(L, columns_vector<T>(L));
+
+      return 0;
+    }
+  );
+}
+
+template <typename T>
+int columns_len(lua_State* const L) noexcept
+{
+  lua_pushinteger(L, columns_vector<T>(L).size());
+
+  return 1;
+}
+
+// upvalue 2 is the method table, upvalue 3 the cursor metatable; the
+// cursors are created on first access and kept in the uservalue of the
+// columns, as the elements of object arrays are
+template <typename T>
+int columns_index(lua_State* const L)
+{
+  int isnum;
+
+  auto const i(lua_tointegerx(L, 2, &isnum));
+
+  if (!isnum)
+  {
+    lua_pushvalue(L, 2);
+    lua_rawget(L, lua_upvalueindex(2));
+  }
+  else if ((i >= 1) && (lua_Unsigned(i) <= columns_vector<T>(L).size()))
+  {
+    lua_getuservalue(L, 1);
+
+    if (!lua_istable(L, -1))
+    {
+      lua_pop(L, 1);
+
+      lua_newtable(L);
+
+      lua_pushvalue(L, -1);
+      lua_setuservalue(L, 1);
+    }
+    // else do nothing
+
+    if (LUA_TUSERDATA != lua_rawgeti(L, -1, i))
+    {
+      lua_pop(L, 1);
+
+      auto& v(columns_vector<T>(L));
+
+      new (lua_newuserdata(L, sizeof(cursor<T>))) cursor<T>{&v, i};
+
+      lua_pushvalue(L, lua_upvalueindex(3));
+      lua_setmetatable(L, -2);
+
+      lua_pushvalue(L, -1);
+      lua_rawseti(L, -3, i);
+    }
+    // else do nothing
+  }
+  else
+  {
+    lua_pushnil(L);
+  }
+
+  return 1;
+}
+
+inline int columns_newindex(lua_State* const L)
+{
+  return luaL_error(L, "assign to fields of elements instead");
+}
+
+template <typename T>
+inline void push_columns_metatables(lua_State* const L)
+{
+  if (LUA_TTABLE != lua_rawgetp(L, LUA_REGISTRYINDEX,
+    proxy_key<columns<T> >()))
+  {
+    lua_pop(L, 1);
+
+    constexpr auto const n(
+      std::tuple_size<decltype(struct_<T>::fields())>{});
+
+    // the names of the fields mapped to their numbers
+    lua_createtable(L, 0, n);
+
+    push_struct_keys<T>(L);
+
+    for (lua_Integer i{1}; i <= lua_Integer(n); ++i)
+    {
+      lua_rawgeti(L, -1, i);
+      lua_pushinteger(L, i);
+      lua_rawset(L, -4);
+    }
+
+    lua_pop(L, 1);
+
+    // the cursor metatable
+    lua_createtable(L, 0, 2);
+
+    lua_pushvalue(L, -2);
+    lua_pushcclosure(L, cursor_index<T>, 1);
+    rawsetfield(L, -2, "__index");
+
+    lua_pushvalue(L, -2);
+    lua_pushcclosure(L, cursor_newindex<T>, 1);
+    rawsetfield(L, -2, "__newindex");
+
+    // the columns metatable
+    lua_createtable(L, 0, 3);
+
+    lua_pushvalue(L, -3);
+
+    lua_createtable(L, 0, 7);
+
+    lua_pushvalue(L, -2);
+    lua_pushcclosure(L, columns_get<T>, 1);
+    rawsetfield(L, -2, "get");
+
+    lua_pushvalue(L, -2);
+    lua_pushcclosure(L, columns_set<T>, 1);
+    rawsetfield(L, -2, "set");
+
+    lua_pushvalue(L, -2);
+    lua_pushcclosure(L, columns_read<T>, 1);
+    rawsetfield(L, -2, "read");
+
+    lua_pushvalue(L, -2);
+    lua_pushcclosure(L, columns_write<T>, 1);
+    rawsetfield(L, -2, "write");
+
+    lua_pushvalue(L, -2);
+    lua_pushcclosure(L, columns_apply<T, &column_ops<T>::fill>, 1);
+    rawsetfield(L, -2, "fill");
+
+    lua_pushvalue(L, -2);
+    lua_pushcclosure(L, columns_apply<T, &column_ops<T>::add>, 1);
+    rawsetfield(L, -2, "add");
+
+    lua_pushvalue(L, -2);
+    lua_pushcclosure(L, columns_apply<T, &column_ops<T>::mul>, 1);
+    rawsetfield(L, -2, "mul");
+
+    lua_pushvalue(L, -4);
+    lua_pushcclosure(L, columns_index<T>, 3);
+    rawsetfield(L, -2, "__index");
+
+    lua_pushcfunction(L, columns_newindex);
+    rawsetfield(L, -2, "__newindex");
+
+    lua_pushcfunction(L, columns_len<T>);
+    rawsetfield(L, -2, "__len");
+
+    lua_replace(L, -3);
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, proxy_key<columns<T> >());
+  }
+  // else do nothing
+}
+
+template <typename T>
+inline std::enable_if_t<
+  is_columns<std::decay_t<T>>{} &&
+  !is_nc_reference<T>{},
+  int
+>
+set(lua_State* const L, T&& c)
+{
+  using type = typename std::decay_t<decltype(*c.get())>::value_type;
+
+  *static_cast<std::vector<type>**>(
+    lua_newuserdata(L, sizeof(std::vector<type>*))) = c.get();
+
+  push_columns_metatables<type>(L);
+  lua_setmetatable(L, -2);
+
+  return 1;
+}
+
+template <typename T>
+struct lua_type_of<T,
+  std::enable_if_t<
+    is_columns<std::decay_t<T>>{} &&
+    !is_nc_reference<T>{}
+  >
+> : std::integral_constant<int, LUA_TUSERDATA> { };
+
+inline int dead_object(lua_State* const L)
+{
+  return luaL_error(L, "attempt to use an object of an ended arena_scope");
+}
+
+// while an arena_scope of a state exists, constructors called by its
+// scripts place the instances into the blocks of the scope, instead of
+// allocating them one by one; the instances are not finalized by the
+// garbage collector, but destroyed, in reverse order, when the scope ends.
+// Their lua objects, also those pushed later by pointer or reference, and
+// methods fetched from them then raise errors, when used. Scopes nest and
+// must end before their state is closed.
+class arena_scope
+{
+  struct entry
+  {
+    void* p;
+
+    void (*destroy)(void*) noexcept;
+  };
+
+  lua_State* const L_;
+
+  arena_scope* const previous_;
+
+  std::size_t const block_size_;
+
+  // the first and last byte of every block
+  std::vector<std::pair<char*, char*>> blocks_;
+
+  char* first_{};
+  char* last_{};
+
+  std::vector<entry> objects_;
+
+  lua_Integer n_{};
+
+  static void const* key() noexcept
+  {
+    static char const k{};
+
+    return &k;
+  }
+
+  // the scopes of all states; while there are none, constructors skip
+  // looking for one
+  static auto& count() noexcept
+  {
+    static std::atomic<std::size_t> n{};
+
+    return n;
+  }
+
+  template <class C>
+  static void destroy(void* const p) noexcept
+  {
+    static_cast<C*>(p)->~C();
+  }
+
+  // the stubs of methods find no object in their upvalues any more, see
+  // batch_object
+  static void kill_method(lua_State* const L) noexcept
+  {
+    if (lua_iscfunction(L, -1))
+    {
+      for (int i(1); i <= 2; ++i)
+      {
+        if (lua_getupvalue(L, -1, i))
+        {
+          auto const object(lua_islightuserdata(L, -1));
+
+          lua_pop(L, 1);
+
+          if (object)
+          {
+            lua_pushnil(L);
+            lua_setupvalue(L, -2, i);
+          }
+          // else do nothing
+        }
+        // else do nothing
+      }
+    }
+    // else do nothing
+  }
+
+  bool owns(void const* const p) const noexcept
+  {
+    auto const q(reinterpret_cast<std::uintptr_t>(p));
+
+    for (auto const& b: blocks_)
+    {
+      if ((q >= std::uintptr_t(b.first)) && (q <= std::uintptr_t(b.second)))
+      {
+        return true;
+      }
+      // else do nothing
+    }
+
+    return false;
+  }
+
+  // the lua object on top is destroyed with the scope
+  void track() noexcept
+  {
+    lua_rawgetp(L_, LUA_REGISTRYINDEX, this);
+    lua_pushvalue(L_, -2);
+    lua_rawseti(L_, -2, ++n_);
+    lua_pop(L_, 1);
+  }
+
+  static void push_dead_metatable(lua_State* const L)
+  {
+    if (LUA_TTABLE != lua_rawgetp(L, LUA_REGISTRYINDEX, proxy_key<entry>()))
+    {
+      lua_pop(L, 1);
+
+      lua_createtable(L, 0, 2);
+
+      lua_pushcfunction(L, dead_object);
+      rawsetfield(L, -2, "__index");
+
+      lua_pushcfunction(L, dead_object);
+      rawsetfield(L, -2, "__newindex");
+
+      lua_pushvalue(L, -1);
+      lua_rawsetp(L, LUA_REGISTRYINDEX, proxy_key<entry>());
+    }
+    // else do nothing
+  }
+
+public:
+  explicit arena_scope(lua_State* const L,
+    std::size_t const block_size = 65536) :
+    L_(L),
+    previous_(of(L)),
+    block_size_(block_size)
+  {
+    // the lua objects of the instances
+    lua_newtable(L);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, this);
+
+    lua_pushlightuserdata(L, this);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, key());
+
+    // the destructor must not allocate
+    push_dead_metatable(L);
+    lua_pop(L, 1);
+
+    ++count();
+  }
+
+  arena_scope(arena_scope const&) = delete;
+
+  arena_scope& operator=(arena_scope const&) = delete;
+
+  ~arena_scope() noexcept
+  {
+    auto const L(L_);
+
+    lua_rawgetp(L, LUA_REGISTRYINDEX, proxy_key<entry>());
+    assert(lua_istable(L, -1));
+
+    lua_rawgetp(L, LUA_REGISTRYINDEX, this);
+
+    for (lua_Integer i{1}; i <= n_; ++i)
+    {
+      lua_rawgeti(L, -1, i);
+
+      lua_pushnil(L);
+
+      while (lua_next(L, -2))
+      {
+        kill_method(L);
+
+        lua_pop(L, 1);
+
+        lua_pushvalue(L, -1);
+        lua_pushnil(L);
+        lua_rawset(L, -4);
+      }
+
+      lua_pushvalue(L, -3);
+      lua_setmetatable(L, -2);
+
+      lua_pop(L, 1);
+    }
+
+    lua_pop(L, 2);
+
+    lua_pushnil(L);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, this);
+
+    if (previous_)
+    {
+      lua_pushlightuserdata(L, previous_);
+    }
+    else
+    {
+      lua_pushnil(L);
+    }
+
+    lua_rawsetp(L, LUA_REGISTRYINDEX, key());
+
+    for (auto i(objects_.rbegin()); i != objects_.rend(); ++i)
+    {
+      if (i->destroy)
+      {
+        i->destroy(i->p);
+      }
+      // else do nothing
+    }
+
+    for (auto const& b: blocks_)
+    {
+      delete [] b.first;
+    }
+
+    --count();
+  }
+
+  // the innermost scope of the state, if any
+  static arena_scope* of(lua_State* const L) noexcept
+  {
+    if (!count().load(std::memory_order_relaxed))
+    {
+      return {};
+    }
+    // else do nothing
+
+    lua_rawgetp(L, LUA_REGISTRYINDEX, key());
+
+    auto const a(static_cast<arena_scope*>(lua_touserdata(L, -1)));
+
+    lua_pop(L, 1);
+
+    return a;
+  }
+
+  auto size() const noexcept { return objects_.size(); }
+
+  // reserves storage for an instance of C, returns its index
+  template <class C>
+  std::size_t allocate()
+  {
+    auto const align(std::uintptr_t(alignof(C)));
+
+    auto p((std::uintptr_t(first_) + align - 1) & ~(align - 1));
+
+    if (!first_ || (p + sizeof(C) > std::uintptr_t(last_)))
+    {
+      auto const size(sizeof(C) + alignof(C) > block_size_ ?
+        sizeof(C) + alignof(C) :
+        block_size_);
+
+      blocks_.reserve(blocks_.size() + 1);
+
+      first_ = new char[size];
+      last_ = first_ + size;
+
+      blocks_.emplace_back(first_, last_ - 1);
+
+      p = (std::uintptr_t(first_) + align - 1) & ~(align - 1);
+    }
+    // else do nothing
+
+    first_ = reinterpret_cast<char*>(p + sizeof(C));
+
+    objects_.push_back({reinterpret_cast<void*>(p), nullptr});
+
+    return objects_.size() - 1;
+  }
+
+  void* data(std::size_t const i) const noexcept { return objects_[i].p; }
+
+  // the instance at index i has been constructed, its lua object is on top
+  // of the stack
+  template <class C>
+  void adopt(std::size_t const i) noexcept
+  {
+    objects_[i].destroy = std::is_trivially_destructible<C>{} ?
+      nullptr :
+      &destroy<C>;
+
+    track();
+  }
+
+  // the wrapper table on top was pushed later, for an instance, that may
+  // be in the blocks of a scope
+  static void track(lua_State* const L, void const* const p) noexcept
+  {
+    for (auto a(of(L)); a; a = a->previous_)
+    {
+      if (a->owns(p))
+      {
+        a->track();
+
+        break;
+      }
+      // else do nothing
+    }
+  }
+};
+
+inline void track_wrapper(lua_State* const L, void const* const p) noexcept
+{
+  arena_scope::track(L, p);
+}
+
+// recycles the storage of instances of C, that lua constructs and collects,
+// through thread local free lists of at most cap() blocks; blocks freed by
+// another thread than the one that allocated them go to its free list
+template <class C>
+class object_pool
+{
+  union node
+  {
+    node* next;
+
+    alignas(C) unsigned char storage[sizeof(C)];
+  };
+
+  struct free_list
+  {
+    node* head{};
+
+    std::size_t size{};
+
+    std::size_t hits{};
+    std::size_t misses{};
+
+    ~free_list() noexcept
+    {
+      trim(0);
+    }
+
+    void trim(std::size_t const n) noexcept
+    {
+      for (; size > n; --size)
+      {
+        delete std::exchange(head, head->next);
+      }
+    }
+  };
+
+  // enable() may run, while other threads allocate
+  static std::atomic<bool> enabled_;
+
+  static std::atomic<std::size_t> cap_;
+
+  static auto& local() noexcept
+  {
+    thread_local free_list l;
+
+    return l;
+  }
+
+public:
+  struct stats_type
+  {
+    std::size_t hits;
+    std::size_t misses;
+
+    // the number of free blocks
+    std::size_t size;
+  };
+
+  static bool enabled() noexcept
+  {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  static std::size_t cap() noexcept
+  {
+    return cap_.load(std::memory_order_relaxed);
+  }
+
+  // once enabled, the pool stays enabled, only the cap can be changed
+  static void enable(std::size_t const cap) noexcept
+  {
+    cap_.store(cap, std::memory_order_relaxed);
+
+    enabled_.store(true, std::memory_order_relaxed);
+  }
+
+  static void* allocate()
+  {
+    auto& l(local());
+
+    if (auto const n = l.head)
+    {
+      l.head = n->next;
+      --l.size;
+
+      ++l.hits;
+
+      return n->storage;
+    }
+    else
+    {
+      ++l.misses;
+
+      return (new node)->storage;
+    }
+  }
+
+  static void deallocate(void* const p) noexcept
+  {
+    auto const n(reinterpret_cast<node*>(p));
+
+    auto& l(local());
+
+    if (l.size < cap())
+    {
+      n->next = l.head;
+      l.head = n;
+      ++l.size;
+    }
+    else
+    {
+      delete n;
+    }
+  }
+
+  // frees all but n free blocks of the calling thread
+  static void trim(std::size_t const n = {}) noexcept
+  {
+    local().trim(n);
+  }
+
+  // the counters of the calling thread
+  static stats_type stats() noexcept
+  {
+    auto const& l(local());
+
+    return {l.hits, l.misses, l.size};
+  }
+
+  static void reset_stats() noexcept
+  {
+    auto& l(local());
+
+    l.hits = l.misses = {};
+  }
+};
+
+template <class C>
+std::atomic<bool> object_pool<C>::enabled_;
+
+template <class C>
+std::atomic<std::size_t> object_pool<C>::cap_;
+
+template <class C>
+int default_finalizer(lua_State* const L)
+  noexcept(noexcept(std::declval<C>().~C()))
+{
+  delete static_cast<C*>(lua_touserdata(L, lua_upvalueindex(1)));
+
+  return {};
+}
+
+template <class C>
+int pool_finalizer(lua_State* const L)
+  noexcept(noexcept(std::declval<C>().~C()))
+{
+  auto const p(static_cast<C*>(lua_touserdata(L, lua_upvalueindex(1))));
+
+  p->~C();
+
+  object_pool<C>::deallocate(p);
+
+  return {};
+}
+
+template <std::size_t O, typename C, typename ...A, std::size_t ...I>
+inline std::enable_if_t<bool(!sizeof...(A)), C*>
+forward(lua_State* const, std::index_sequence<I...> const) noexcept(
+  noexcept(C())
+)
+{
+  return new C();
+}
+
+template <std::size_t O, typename C, typename ...A, std::size_t ...I>
+inline std::enable_if_t<bool(sizeof...(A)), C*>
+forward(lua_State* const L, std::index_sequence<I...> const) noexcept(
+  noexcept(C(get<I + O, A>(L)...))
+)
+{
+  scratch_scope<A...> const s(L);
+
+  return new C(get<I + O, A>(L)...);
+}
+
+template <std::size_t O, typename C, typename ...A, std::size_t ...I>
+inline std::enable_if_t<bool(!sizeof...(A)), C*>
+forward(lua_State* const, void* const p, std::index_sequence<I...> const)
+  noexcept(noexcept(C()))
+{
+  return new (p) C();
+}
+
+template <std::size_t O, typename C, typename ...A, std::size_t ...I>
+inline std::enable_if_t<bool(sizeof...(A)), C*>
+forward(lua_State* const L, void* const p, std::index_sequence<I...> const)
+  noexcept(noexcept(C(get<I + O, A>(L)...)))
+{
+  scratch_scope<A...> const s(L);
+
+  return new (p) C(get<I + O, A>(L)...);
+}
+
+template <std::size_t O, class C, class ...A>
+int constructor_stub(lua_State* const L)
+  noexcept(noexcept(
+    forward<O, C, A...>(L, std::make_index_sequence<sizeof...(A)>()))
+  )
+{
+  assert(sizeof...(A) == lua_gettop(L));
+
+  C* instance;
+
+  auto const arena(arena_scope::of(L));
+
+  std::size_t j{};
+
+  auto const pooled(!arena && object_pool<C>::enabled());
+
+  exception_barrier(L,
+    [&]() noexcept(noexcept(
+      forward<O, C, A...>(L, std::make_index_sequence<sizeof...(A)>()))
+    ) {
+      if (arena)
+      {
+        j = arena->allocate<C>();
+
+        instance = forward<O, C, A...>(L, arena->data(j),
+          std::make_index_sequence<sizeof...(A)>());
+      }
+      else if (pooled)
+      {
+        // the block is returned, if the constructor throws
+        struct guard
+        {
+          void* p;
+
+          ~guard() noexcept
+          {
+            if (p)
+            {
+              object_pool<C>::deallocate(p);
+            }
+            // else do nothing
+          }
+        } g{object_pool<C>::allocate()};
+
+        instance = forward<O, C, A...>(L, g.p,
+          std::make_index_sequence<sizeof...(A)>());
+
+        g.p = {};
+      }
+      else
+      {
+        instance = forward<O, C, A...>(L,
+          std::make_index_sequence<sizeof...(A)>());
+      }
+
+      return 0;
+    }
+  );
+
+  // table
+  lua_createtable(L, 0, default_nrec);
+
+  push_defs(L, instance);
+
+  // metatable
   assert(lua_istable(L, -1));
+  lua_createtable(L, 0, 4);
+
+  // gc, instances in an arena are destroyed with it
+  assert(lua_istable(L, -1));
+
+  if (!arena)
+  {
+    lua_pushlightuserdata(L, instance);
+
+    lua_pushcclosure(L, pooled ? pool_finalizer<C> : default_finalizer<C>,
+      1);
+
+    rawsetfield(L, -2, "__gc");
+  }
+  // else do nothing
+
+  // wrap
+  assert(lua_istable(L, -1));
+
+  lua_pushnil(L);
+  lua_pushlightuserdata(L, instance);
+
+  lua_pushcclosure(L, wrap_stub<C>, 2);
+
+  rawsetfield(L, -2, "__wrap");
+
+  // getters
+  assert(lua_istable(L, -1));
+
+  lua_pushnil(L);
+  lua_pushlightuserdata(L, instance);
+  lua_pushlightuserdata(L, instance);
+
+  lua_pushcclosure(L, getter<C>, 3);
+
+  rawsetfield(L, -2, "__index");
+
+  // setters
+  assert(lua_istable(L, -1));
+
+  lua_pushnil(L);
+  lua_pushlightuserdata(L, instance);
+  lua_pushlightuserdata(L, instance);
+
+  lua_pushcclosure(L, setter<C>, 3);
+
+  rawsetfield(L, -2, "__newindex");
+
+  lua_setmetatable(L, -2);
+  assert(lua_istable(L, -1));
+
+  if (arena)
+  {
+    arena->adopt<C>(j);
+  }
+  // else do nothing
+
+  return 1;
+}
+
+// the instances, new_array() constructs, are placed in the userdata of the
+// array, right after this header
+template <class C>
+struct object_array
+{
+  // the number of constructed instances
+  std::size_t size;
+
+  C* data;
+};
+
+template <class C>
+int object_array_gc(lua_State* const L)
+  noexcept(noexcept(std::declval<C>().~C()))
+{
+  auto const a(static_cast<object_array<C>*>(lua_touserdata(L, 1)));
+
+  for (auto i(a->size); i;)
+  {
+    a->data[--i].~C();
+  }
+
+  return {};
+}
+
+template <class C>
+int object_array_len(lua_State* const L) noexcept
+{
+  lua_pushinteger(L,
+    static_cast<object_array<C>*>(lua_touserdata(L, 1))->size);
+
+  return 1;
+}
+
+// the element at the index at 2 of the array at 1
+template <class C>
+inline C* object_array_element(lua_State* const L)
+{
+  auto const ok(lua_getmetatable(L, 1) && (LUA_TTABLE == lua_rawgetp(L,
+    LUA_REGISTRYINDEX, proxy_key<object_array<C> >())) &&
+    lua_rawequal(L, -1, -2));
+
+  luaL_argcheck(L, ok, 1, "array expected");
+
+  lua_pop(L, 2);
+
+  auto const a(static_cast<object_array<C>*>(lua_touserdata(L, 1)));
+
+  auto const i(luaL_checkinteger(L, 2));
+
+  luaL_argcheck(L, (i > 0) && (lua_Unsigned(i) <= a->size), 2,
+    "index out of range");
+
+  return a->data + (i - 1);
+}
+
+// ps:get(i, name) returns a property of element i, without wrapping it;
+// upvalue 1 holds false, so that returned objects are not cached there,
+// upvalue 2 is rewritten, see prepare_accessor
+template <class C>
+int object_array_get(lua_State* const L)
+{
+  auto const p(object_array_element<C>(L));
+
+  lua_settop(L, 3);
+
+  if (auto const a = LUA_TSTRING == lua_type(L, 3) ?
+    find_getter<C>(lua_tostring(L, 3)) :
+    nullptr)
+  {
+    call_getter(L, *a, p, 3);
+  }
+  else
+  {
+    lua_pushnil(L);
+    lua_replace(L, 3);
+  }
+
+  return 1;
+}
+
+// ps:set(i, name, value) sets a property of element i
+template <class C>
+int object_array_set(lua_State* const L)
+{
+  auto const p(object_array_element<C>(L));
+
+  // the setter expects the value at 3
+  lua_settop(L, 4);
+
+  if (auto const a = LUA_TSTRING == lua_type(L, 3) ?
+    find_setter<C>(lua_tostring(L, 3)) :
+    nullptr)
+  {
+    lua_replace(L, 3);
+
+    prepare_accessor(L, *a, p);
+
+    std::get<1>(*a)(L);
+  }
+  // else do nothing
+
+  return {};
+}
+
+// elements are wrapped, like pointers returned to lua, on first access; the
+// wrappers are kept in the uservalue of the array and keep it alive; other
+// keys are looked up in upvalue 1, that holds get and set
+template <class C>
+int object_array_index(lua_State* const L)
+{
+  auto const a(static_cast<object_array<C>*>(lua_touserdata(L, 1)));
+
+  int isnum;
+
+  auto const i(lua_tointegerx(L, 2, &isnum));
+
+  if (!isnum)
+  {
+    lua_rawget(L, lua_upvalueindex(1));
+  }
+  else if ((i > 0) && (lua_Unsigned(i) <= a->size))
+  {
+    lua_getuservalue(L, 1);
+
+    if (LUA_TTABLE != lua_rawgeti(L, -1, i))
+    {
+      lua_pop(L, 1);
+
+      new_wrapper_table(L, a->data + (i - 1), 4);
+
+      lua_pushvalue(L, 1);
+      rawsetfield(L, -2, "__array");
+
+      lua_setmetatable(L, -2);
+
+      lua_pushvalue(L, -1);
+      lua_rawseti(L, -3, i);
+    }
+    // else do nothing
+  }
+  else
+  {
+    lua_pushnil(L);
+  }
+
+  return 1;
+}
+
+template <class C>
+inline void push_object_array_metatable(lua_State* const L)
+{
+  if (LUA_TTABLE != lua_rawgetp(L, LUA_REGISTRYINDEX,
+    proxy_key<object_array<C> >()))
+  {
+    lua_pop(L, 1);
+
+    lua_createtable(L, 0, 3);
+
+    lua_createtable(L, 0, 2);
+
+    lua_pushboolean(L, false);
+    lua_pushnil(L);
+    lua_pushcclosure(L, object_array_get<C>, 2);
+    rawsetfield(L, -2, "get");
+
+    lua_pushboolean(L, false);
+    lua_pushnil(L);
+    lua_pushcclosure(L, object_array_set<C>, 2);
+    rawsetfield(L, -2, "set");
+
+    lua_pushcclosure(L, object_array_index<C>, 1);
+    rawsetfield(L, -2, "__index");
+
+    lua_pushcfunction(L, object_array_len<C>);
+    rawsetfield(L, -2, "__len");
+
+    if (!std::is_trivially_destructible<C>{})
+    {
+      lua_pushcfunction(L, object_array_gc<C>);
+      rawsetfield(L, -2, "__gc");
+    }
+    // else do nothing
+
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, proxy_key<object_array<C> >());
+  }
+  // else do nothing
+}
+
+// new_array(n, ...) constructs n instances, all with the same arguments, in
+// a single userdata, that indexes them from 1
+template <class C, class ...A>
+int array_constructor_stub(lua_State* const L)
+  noexcept(noexcept(forward<2, C, A...>(L, static_cast<void*>(nullptr),
+    std::make_index_sequence<sizeof...(A)>()))
+  )
+{
+  assert(sizeof...(A) + 1 == lua_gettop(L));
+
+  auto const n(luaL_checkinteger(L, 1));
+
+  luaL_argcheck(L, (n >= 0) && (lua_Unsigned(n) <=
+    (std::size_t(-1) - sizeof(object_array<C>) - alignof(C)) / sizeof(C)),
+    1, "invalid number of instances");
+
+  auto const a(new (lua_newuserdata(L,
+    sizeof(object_array<C>) + alignof(C) - 1 + n * sizeof(C)))
+    object_array<C>{});
+
+  a->data = reinterpret_cast<C*>(
+    (std::uintptr_t(a + 1) + alignof(C) - 1) &
+    ~(std::uintptr_t(alignof(C)) - 1));
+
+  lua_newtable(L);
+  lua_setuservalue(L, -2);
+
+  push_object_array_metatable<C>(L);
+  lua_setmetatable(L, -2);
+
+  exception_barrier(L,
+    [&]() noexcept(noexcept(forward<2, C, A...>(L,
+      static_cast<void*>(nullptr), std::make_index_sequence<sizeof...(A)>()))
+    ) {
+      for (; std::size_t(n) != a->size; ++a->size)
+      {
+        forward<2, C, A...>(L, a->data + a->size,
+          std::make_index_sequence<sizeof...(A)>());
+      }
+
+      return 0;
+    }
+  );
+
+  return 1;
+}
+
+template <std::size_t O, typename R, typename ...A, std::size_t ...I>
+inline std::enable_if_t<bool(!sizeof...(A)), R>
+forward(lua_State* const, R (* const f)(A...),
+  std::index_sequence<I...> const) noexcept(noexcept((*f)()))
+{
+  return (*f)();
+}
+
+template <std::size_t O, typename R, typename ...A, std::size_t ...I>
+inline std::enable_if_t<bool(sizeof...(A)), R>
+forward(lua_State* const L, R (* const f)(A...),
+  std::index_sequence<I...> const) noexcept(
+  noexcept((*f)(get<I + O, A>(L)...))
+)
+{
+  scratch_scope<A...> const s(L);
+
+  return (*f)(get<I + O, A>(L)...);
+}
+
+template <typename FP, FP fp, std::size_t O, class R, class ...A>
+inline std::enable_if_t<std::is_void<R>{}, int>
+func_stub(lua_State* const L) noexcept(
+  noexcept(
+    forward<O, R, A...>(L, fp, std::make_index_sequence<sizeof...(A)>())
+  )
+)
+{
+  assert(sizeof...(A) == lua_gettop(L));
+
+  return exception_barrier(L,
+    [L]() noexcept(noexcept(
+      forward<O, R, A...>(L, fp, std::make_index_sequence<sizeof...(A)>()))
+    ) {
+      forward<O, R, A...>(L, fp, std::make_index_sequence<sizeof...(A)>());
+
+      return 0;
+    }
+  );
+}
+
+template <typename FP, FP fp, std::size_t O, class R, class ...A>
+inline std::enable_if_t<!std::is_void<R>{}, int>
+func_stub(lua_State* const L) noexcept(
+  noexcept(
+    set(L, forward<O, R, A...>(L, fp,
+    std::make_index_sequence<sizeof...(A)>()))
+  )
+)
+{
+  return exception_barrier(L,
+    [L]() noexcept(noexcept(set(L, forward<O, R, A...>(L, fp,
+      std::make_index_sequence<sizeof...(A)>())))
+    ) {
+      return set(L, forward<O, R, A...>(L, fp,
+        std::make_index_sequence<sizeof...(A)>()));
+    }
+  );
+}
+
+template <typename FP, FP fp, class R>
+inline std::enable_if_t<!std::is_void<R>{}, int>
+vararg_func_stub(lua_State* const L) noexcept(noexcept(set(L, fp(L))))
+{
+  return exception_barrier(L,
+    [L]() noexcept(noexcept(set(L, fp(L)))) { return set(L, fp(L)); }
+  );
+}
+
+template <typename FP, FP fp, class R>
+inline std::enable_if_t<std::is_void<R>{}, int>
+vararg_func_stub(lua_State* const L) noexcept(noexcept(fp(L)))
+{
+  return exception_barrier(L,
+    [L]() noexcept(noexcept(fp(L))) { fp(L); return 0; }
+  );
+}
+
+template <std::size_t O, typename C, typename R, typename ...A,
+  std::size_t ...I>
+inline std::enable_if_t<bool(!sizeof...(A)), R>
+forward(lua_State* const, C* const c,
+  R (C::* const ptr_to_member)(A...) const,
+  std::index_sequence<I...> const) noexcept(
+  noexcept((c->*ptr_to_member)())
+)
+{
+  return (c->*ptr_to_member)();
+}
+
+template <std::size_t O, typename C, typename R, typename ...A,
+  std::size_t ...I>
+inline std::enable_if_t<bool(!sizeof...(A)), R>
+forward(lua_State* const, C* const c,
+  R (C::* const ptr_to_member)(A...),
+  std::index_sequence<I...> const) noexcept(
+  noexcept((c->*ptr_to_member)())
+)
+{
+  return (c->*ptr_to_member)();
+}
+
+template <std::size_t O, typename C, typename R, typename ...A,
+  std::size_t ...I>
+inline std::enable_if_t<bool(sizeof...(A)), R>
+forward(lua_State* const L, C* const c,
+  R (C::* const ptr_to_member)(A...) const,
+  std::index_sequence<I...> const) noexcept(
+  noexcept((c->*ptr_to_member)(get<I + O, A>(L)...))
+)
+{
+  scratch_scope<A...> const s(L);
+
+  return (c->*ptr_to_member)(get<I + O, A>(L)...);
+}
+
+template <std::size_t O, typename C, typename R,
+  typename ...A, std::size_t ...I>
+inline std::enable_if_t<bool(sizeof...(A)), R>
+forward(lua_State* const L, C* const c,
+  R (C::* const ptr_to_member)(A...), std::index_sequence<I...> const)
+  noexcept(noexcept((c->*ptr_to_member)(get<I + O, A>(L)...)))
+{
+  scratch_scope<A...> const s(L);
+
+  return (c->*ptr_to_member)(get<I + O, A>(L)...);
+}
+
+template <typename FP, FP fp, std::size_t O, class C, class R, class ...A>
+inline std::enable_if_t<!std::is_void<R>{}, int>
+member_stub(lua_State* const L) noexcept(
+  noexcept(set(L,
+    forward<O, C, R, A...>(L,
+      static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2))),
+      fp,
+      std::make_index_sequence<sizeof...(A)>()))
+  )
+)
+{
+//std::cout << lua_gettop(L) << " " << sizeof...(A) + O - 1 << std::endl;
+  // property stubs (O == 3) may find more values above their arguments,
+  // see batch_get
+  assert(3 == O ?
+    int(sizeof...(A) + O - 1) <= lua_gettop(L) :
+    int(sizeof...(A) + O - 1) == lua_gettop(L));
+
+  if (!lua_touserdata(L, lua_upvalueindex(2)))
+  {
+    return dead_object(L);
+  }
+  // else do nothing
+
+  return exception_barrier(L,
+    [L]() noexcept(noexcept(set(L,
+      forward<O, C, R, A...>(L,
+        static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2))),
+        fp,
+        std::make_index_sequence<sizeof...(A)>())))
+    ) {
+      return set(L,
+        forward<O, C, R, A...>(L,
+          static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2))),
+          fp,
+          std::make_index_sequence<sizeof...(A)>()));
+    }
+  );
+}
+
+template <typename FP, FP fp, std::size_t O, class C, class R, class ...A>
+inline std::enable_if_t<std::is_void<R>{}, int>
+member_stub(lua_State* const L) noexcept(
+  noexcept(forward<O, C, R, A...>(L,
+    static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2))),
+    fp,
+    std::make_index_sequence<sizeof...(A)>())
+  )
+)
+{
+  assert(3 == O ?
+    int(sizeof...(A) + O - 1) <= lua_gettop(L) :
+    int(sizeof...(A) + O - 1) == lua_gettop(L));
+
+  if (!lua_touserdata(L, lua_upvalueindex(2)))
+  {
+    return dead_object(L);
+  }
+  // else do nothing
+
+  return exception_barrier(L,
+    [L]() noexcept(noexcept(forward<O, C, R, A...>(L,
+      static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2))),
+      fp,
+      std::make_index_sequence<sizeof...(A)>()))
+    ) {
+      forward<O, C, R, A...>(L,
+        static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2))),
+        fp,
+        std::make_index_sequence<sizeof...(A)>());
+
+      return 0;
+    }
+  );
+}
+
+template <typename FP, FP fp, class C, class R>
+inline std::enable_if_t<!std::is_void<R>{}, int>
+vararg_member_stub(lua_State* const L) noexcept(
+  noexcept(set(L, (static_cast<C*>(
+    lua_touserdata(L, lua_upvalueindex(2)))->*fp)(L))
+  )
+)
+{
+  if (!lua_touserdata(L, lua_upvalueindex(2)))
+  {
+    return dead_object(L);
+  }
+  // else do nothing
+
+  return exception_barrier(L,
+    [L]() noexcept(noexcept(set(L, (static_cast<C*>(
+      lua_touserdata(L, lua_upvalueindex(2)))->*fp)(L)))
+    ) {
+      return set(L,
+        (static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2)))->*fp)(L)
+      );
+    }
+  );
+}
+
+template <typename FP, FP fp, class C, class R>
+inline std::enable_if_t<std::is_void<R>{}, int>
+vararg_member_stub(lua_State* const L) noexcept(
+  noexcept(
+    (static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2)))->*fp)(L)
+  )
+)
+{
+  if (!lua_touserdata(L, lua_upvalueindex(2)))
+  {
+    return dead_object(L);
+  }
+  // else do nothing
+
+  return exception_barrier(L,
+    [L]() noexcept(noexcept(
+      (static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2)))->*fp)(L))
+    ) {
+      (static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2)))->*fp)(L);
+
+      return 0;
+    }
+  );
+}
+
+template <typename FP, FP fp, std::size_t O, class R, class ...A>
+constexpr inline lua_CFunction func_stub(R (*)(A...)) noexcept
+{
+  return &func_stub<FP, fp, O, R, A...>;
+}
+
+template <typename FP, FP fp, std::size_t O, class R, class C, class ...A>
+constexpr inline lua_CFunction member_stub(R (C::*)(A...)) noexcept
+{
+  return &member_stub<FP, fp, O, C, R, A...>;
+}
+
+template <typename FP, FP fp, std::size_t O, class R, class C, class ...A>
+constexpr inline lua_CFunction member_stub(R (C::*)(A...) const) noexcept
+{
+  return &member_stub<FP, fp, O, C, R, A...>;
+}
+
+template <typename FP, FP fp, class R, class C>
+constexpr inline lua_CFunction vararg_member_stub(R (C::*)(lua_State*)) noexcept
+{
+  return &vararg_member_stub<FP, fp, C, R>;
+}
+
+template <typename FP, FP fp, class R, class C>
+constexpr inline lua_CFunction vararg_member_stub(R (C::*)(lua_State*) const) noexcept
+{
+  return &vararg_member_stub<FP, fp, C, R>;
+}
+
+template <int I>
+constexpr inline bool match_args(lua_State* const) noexcept
+{
+  return true;
+}
+
+template <int I, typename A, typename ...B>
+inline bool match_args(lua_State* const L) noexcept
+{
+  return ((LUA_TNONE == lua_type_of<A>{}) ||
+    (lua_type_of<A>{} == lua_type(L, I))) &&
+    match_args<I + 1, B...>(L);
+}
+
+template <std::size_t O, typename FP, FP fp, typename R, typename ...A>
+inline lua_CFunction select_overload(lua_State* const L, int const top,
+  R (* const)(A...)) noexcept
+{
+  return (int(sizeof...(A) + O - 1) == top) &&
+    match_args<int(O), A...>(L) ?
+    func_stub<FP, fp, O>(fp) :
+    nullptr;
+}
+
+template <std::size_t O, typename FP, FP fp, typename R, class C,
+  typename ...A>
+inline lua_CFunction select_overload(lua_State* const L, int const top,
+  R (C::* const)(A...)) noexcept
+{
+  return (int(sizeof...(A) + O - 1) == top) &&
+    match_args<int(O), A...>(L) ?
+    member_stub<FP, fp, O>(fp) :
+    nullptr;
+}
+
+template <std::size_t O, typename FP, FP fp, typename R, class C,
+  typename ...A>
+inline lua_CFunction select_overload(lua_State* const L, int const top,
+  R (C::* const)(A...) const) noexcept
+{
+  return (int(sizeof...(A) + O - 1) == top) &&
+    match_args<int(O), A...>(L) ?
+    member_stub<FP, fp, O>(fp) :
+    nullptr;
+}
+
+// one member of an overload set, see def<overload<...>, overload<...>>()
+template <typename FP, FP fp>
+struct overload
+{
+  static constexpr bool is_member{std::is_member_function_pointer<FP>{}};
+
+  template <std::size_t O>
+  static lua_CFunction select(lua_State* const L, int const top) noexcept
+  {
+    return select_overload<O, FP, fp>(L, top, fp);
+  }
+};
+
+template <std::size_t O>
+constexpr inline lua_CFunction first_overload(lua_State* const,
+  int const) noexcept
+{
+  return nullptr;
+}
+
+template <std::size_t O, class F, class ...G>
+inline lua_CFunction first_overload(lua_State* const L,
+  int const top) noexcept
+{
+  auto const f(F::template select<O>(L, top));
+
+  return f ? f : first_overload<O, G...>(L, top);
+}
+
+// candidates are tried in declaration order, the first one whose arity
+// and argument lua types match is called
+template <std::size_t O, class ...F>
+int overload_stub(lua_State* const L)
+{
+  auto const f(first_overload<O, F...>(L, lua_gettop(L)));
+
+  return f ? f(L) : luaL_error(L, "no matching overload");
+}
+
+template <typename R>
+constexpr inline enum property_type get_property_type() noexcept
+{
+  if (std::is_same<std::decay_t<R>, bool>{})
+  {
+    return BOOLEAN;
+  }
+  else if (std::is_integral<R>{})
+  {
+    return INTEGER;
+  }
+  else if (std::is_floating_point<R>{})
+  {
+    return NUMBER;
+  }
+  else if (std::is_same<R, std::string const&>{} ||
+    std::is_same<std::decay_t<R>, char const*>{})
+  {
+    return STRING;
+  }
+  else
+  {
+    return OTHER;
+  }
+}
+
+template <typename FP, FP fp, class R, class C, class ...A>
+constexpr inline auto get_property_type( R (C::* const)(A...)) noexcept
+{
+  return get_property_type<R>();
+}
+
+template <typename FP, FP fp, class R, class C, class ...A>
+constexpr inline auto get_property_type(R (C::* const)(A...) const) noexcept
+{
+  return get_property_type<R>();
+}
+
+template <typename ...A>
+inline void call(lua_State* const L, int const nresults, A&& ...args)
+  noexcept(noexcept(swallow{(set(L, std::forward<A>(args)))...}))
+{
+  int ac{};
+
+  swallow{
+    (ac += set(L, std::forward<A>(args)))...
+  };
+  assert(ac >= int(sizeof...(A)));
+
+  lua_call(L, ac, nresults);
+}
+
+class scheduler;
+
+// handed to async functions, resumes the suspended task when called
+class completion
+{
+  friend class scheduler;
+
+  scheduler* s_;
+
+  lua_State* thread_;
+
+  std::uint64_t serial_;
+
+  completion(scheduler* const s, lua_State* const thread,
+    std::uint64_t const serial) noexcept :
+    s_(s),
+    thread_(thread),
+    serial_(serial)
+  {
+  }
+
+public:
+  // the results are returned by the async function
+  template <typename ...A>
+  bool operator()(A&& ...results) const;
+
+  // the message is raised as an error by the async function
+  bool fail(char const* msg) const;
+};
+
+// drives any number of lua coroutines (tasks) of a single state, a task
+// is suspended by calling an async function and is resumed by completion
+class scheduler
+{
+  struct task
+  {
+    int ref;
+
+    int nargs;
+
+    std::uint64_t serial;
+
+    bool async;
+  };
+
+  lua_State* const L_;
+
+  std::unordered_map<lua_State*, task> tasks_;
+
+  std::vector<lua_State*> ready_;
+  std::vector<lua_State*> running_;
+
+  std::uint64_t serial_{};
+
+  static void const* key() noexcept
+  {
+    static char const k{};
+
+    return &k;
+  }
+
+  void release(decltype(tasks_)::iterator const i) noexcept
+  {
+    // a completion may have requeued the task before it failed
+    ready_.erase(std::remove(ready_.begin(), ready_.end(), i->first),
+      ready_.end());
+
+    luaL_unref(L_, LUA_REGISTRYINDEX, i->second.ref);
+
+    tasks_.erase(i);
+  }
+
+  void step(lua_State* const thread)
+  {
+    auto const i(tasks_.find(thread));
+
+    if (tasks_.end() == i)
+    {
+      // released while queued
+      return;
+    }
+    // else do nothing
+
+    auto const nargs(i->second.nargs);
+    i->second.nargs = 0;
+
+    int nres;
+
+#if LUA_VERSION_NUM >= 504
+    switch (lua_resume(thread, L_, nargs, &nres))
+#else
+    auto const status(lua_resume(thread, L_, nargs));
+    nres = lua_gettop(thread);
+
+    switch (status)
+#endif // LUA_VERSION_NUM
+    {
+      case LUA_YIELD:
+        lua_pop(thread, nres);
+
+        if (i->second.async)
+        {
+          // the completion requeues the task
+          i->second.async = false;
+        }
+        else
+        {
+          // coroutine.yield(), let the other tasks run
+          ready_.push_back(thread);
+        }
+
+        break;
+
+      case LUA_OK:
+        release(i);
+
+        break;
+
+      default:
+      {
+        error e(lua_isstring(thread, -1) ? lua_tostring(thread, -1) :
+          "lua error");
+
+        release(i);
+
+        throw e;
+      }
+    }
+  }
+
+public:
+  explicit scheduler(lua_State* const L) : L_(L)
+  {
+    assert(!of(L));
+    lua_pushlightuserdata(L, this);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, key());
+  }
+
+  scheduler(scheduler const&) = delete;
+
+  scheduler& operator=(scheduler const&) = delete;
+
+  ~scheduler() noexcept
+  {
+    while (!tasks_.empty())
+    {
+      release(tasks_.begin());
+    }
+
+    lua_pushnil(L_);
+    lua_rawsetp(L_, LUA_REGISTRYINDEX, key());
+  }
+
+  static scheduler* of(lua_State* const L) noexcept
+  {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, key());
+
+    auto const s(static_cast<scheduler*>(lua_touserdata(L, -1)));
+
+    lua_pop(L, 1);
+
+    return s;
+  }
+
+  // number of tasks not yet finished
+  auto size() const noexcept { return tasks_.size(); }
+
+  bool is_task(lua_State* const L) const noexcept
+  {
+    return tasks_.count(L);
+  }
+
+  // pops a function and nargs arguments and starts a task for them
+  lua_State* spawn(int const nargs)
+  {
+    assert(lua_isfunction(L_, -nargs - 1));
+    auto const thread(lua_newthread(L_));
+    lua_insert(L_, -nargs - 2);
+
+    lua_xmove(L_, thread, nargs + 1);
+
+    tasks_.emplace(thread,
+      task{luaL_ref(L_, LUA_REGISTRYINDEX), nargs, {}, {}});
+    ready_.push_back(thread);
+
+    return thread;
+  }
+
+  // resumes ready tasks, until all are finished or waiting for completion,
+  // a task error is thrown as lualite::error, after which run() may be
+  // called again
+  std::size_t run()
+  {
+    while (!ready_.empty())
+    {
+      running_.swap(ready_);
+
+      for (auto i(running_.cbegin()), cend(running_.cend()); i != cend; ++i)
+      {
+        try
+        {
+          step(*i);
+        }
+        catch (...)
+        {
+          ready_.insert(ready_.cbegin(), i + 1, cend);
+          running_.clear();
+
+          throw;
+        }
+      }
+
+      running_.clear();
+    }
+
+    return tasks_.size();
+  }
+
+  completion suspend(lua_State* const L)
+  {
+    auto const i(tasks_.find(L));
+    assert(tasks_.end() != i);
+    assert(!i->second.serial);
+
+    i->second.async = true;
+
+    return {this, L, i->second.serial = ++serial_};
+  }
+
+  template <typename ...A>
+  bool resume(completion const& c, A&& ...results)
+  {
+    auto const i(tasks_.find(c.thread_));
+
+    if ((tasks_.end() == i) || !c.serial_ || (c.serial_ != i->second.serial))
+    {
+      return false;
+    }
+    else
+    {
+      i->second.serial = {};
+
+      auto const L(c.thread_);
+
+      int const n[]{(lua_pushboolean(L, true), 1),
+        set(L, static_cast<std::decay_t<A> const&>(results))...};
+
+      // an async function may complete before it yields
+      if (LUA_YIELD == lua_status(L))
+      {
+        for (auto const j: n)
+        {
+          i->second.nargs += j;
+        }
+      }
+      // else do nothing
+
+      ready_.push_back(L);
+
+      return true;
+    }
+  }
+
+  bool fail(completion const& c, char const* const msg)
+  {
+    auto const i(tasks_.find(c.thread_));
+
+    if ((tasks_.end() == i) || !c.serial_ || (c.serial_ != i->second.serial))
+    {
+      return false;
+    }
+    else
+    {
+      i->second.serial = {};
+
+      auto const L(c.thread_);
+
+      lua_pushboolean(L, false);
+      lua_pushstring(L, msg);
+
+      if (LUA_YIELD == lua_status(L))
+      {
+        i->second.nargs = 2;
+      }
+      // else do nothing
+
+      ready_.push_back(L);
+
+      return true;
+    }
+  }
+};
+
+template <typename ...A>
+inline bool completion::operator()(A&& ...results) const
+{
+  return s_->resume(*this, std::forward<A>(results)...);
+}
+
+inline bool completion::fail(char const* const msg) const
+{
+  return s_->fail(*this, msg);
+}
+
+// the stack holds the completion status followed by the results
+inline int async_continuation(lua_State* const L, int, lua_KContext)
+{
+  if (lua_toboolean(L, 1))
+  {
+    return lua_gettop(L) - 1;
+  }
+  else
+  {
+    lua_settop(L, 2);
 
-  return 1;
+    return lua_error(L);
+  }
 }
 
-template <std::size_t O, typename R, typename ...A, std::size_t ...I>
-inline std::enable_if_t<bool(!sizeof...(A)), R>
-forward(lua_State* const, R (* const f)(A...),
-  std::index_sequence<I...> const) noexcept(noexcept((*f)()))
+template <typename FP, FP fp, std::size_t O, class ...A, std::size_t ...I>
+inline std::enable_if_t<bool(!sizeof...(A))>
+forward_async(lua_State* const, completion const& c,
+  std::index_sequence<I...> const)
 {
-  return (*f)();
+  (*fp)(c);
 }
 
-template <std::size_t O, typename R, typename ...A, std::size_t ...I>
-inline std::enable_if_t<bool(sizeof...(A)), R>
-forward(lua_State* const L, R (* const f)(A...),
-  std::index_sequence<I...> const) noexcept(
-  noexcept((*f)(get<I + O, A>(L)...))
-)
+template <typename FP, FP fp, std::size_t O, class ...A, std::size_t ...I>
+inline std::enable_if_t<bool(sizeof...(A))>
+forward_async(lua_State* const L, completion const& c,
+  std::index_sequence<I...> const)
 {
-  return (*f)(get<I + O, A>(L)...);
+  (*fp)(c, get<I + O, A>(L)...);
 }
 
-template <typename FP, FP fp, std::size_t O, class R, class ...A>
-inline std::enable_if_t<std::is_void<R>{}, int>
-func_stub(lua_State* const L) noexcept(
-  noexcept(
-    forward<O, R, A...>(L, fp, std::make_index_sequence<sizeof...(A)>())
-  )
-)
+template <typename FP, FP fp, std::size_t O, class C, class ...A,
+  std::size_t ...I>
+inline void forward_async_member(lua_State* const L, completion const& c,
+  std::index_sequence<I...> const)
 {
-  assert(sizeof...(A) == lua_gettop(L));
+  (static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2)))->*fp)(c,
+    get<I + O, A>(L)...);
+}
 
-  forward<O, R, A...>(L, fp, std::make_index_sequence<sizeof...(A)>());
+inline int async_suspend(lua_State* const L, int const top)
+{
+  // drop the arguments, keeping results of an early completion
+  lua_rotate(L, 1, -top);
+  lua_pop(L, top);
 
-  return {};
+  return lua_yieldk(L, 0, 0, async_continuation);
 }
 
-template <typename FP, FP fp, std::size_t O, class R, class ...A>
-inline std::enable_if_t<!std::is_void<R>{}, int>
-func_stub(lua_State* const L) noexcept(
-  noexcept(
-    set(L, forward<O, R, A...>(L, fp,
-    std::make_index_sequence<sizeof...(A)>()))
-  )
-)
+inline scheduler* async_scheduler(lua_State* const L)
 {
-  return set(L, forward<O, R, A...>(L, fp,
-    std::make_index_sequence<sizeof...(A)>()));
+  auto const s(scheduler::of(L));
+
+  return s && s->is_task(L) ? s :
+    (luaL_error(L, "async function called outside of a scheduler task"),
+    nullptr);
 }
 
-template <typename FP, FP fp, class R>
-inline std::enable_if_t<!std::is_void<R>{}, int>
-vararg_func_stub(lua_State* const L) noexcept(noexcept(set(fp(L))))
+template <typename FP, FP fp, std::size_t O, class ...A>
+int async_func_stub(lua_State* const L)
 {
-  return set(fp(L));
+  auto const top(lua_gettop(L));
+  assert(int(sizeof...(A) + O - 1) == top);
+
+  auto const c(async_scheduler(L)->suspend(L));
+
+  exception_barrier(L,
+    [&]() {
+      forward_async<FP, fp, O, A...>(L, c,
+        std::make_index_sequence<sizeof...(A)>());
+
+      return 0;
+    }
+  );
+
+  return async_suspend(L, top);
 }
 
-template <typename FP, FP fp, class R>
-inline std::enable_if_t<std::is_void<R>{}, int>
-vararg_func_stub(lua_State* const L) noexcept(noexcept(fp(L)))
+template <typename FP, FP fp, std::size_t O, class C, class ...A>
+int async_member_stub(lua_State* const L)
 {
-  fp(L);
+  auto const top(lua_gettop(L));
+  assert(int(sizeof...(A) + O - 1) == top);
 
-  return {};
+  if (!lua_touserdata(L, lua_upvalueindex(2)))
+  {
+    return dead_object(L);
+  }
+  // else do nothing
+
+  auto const c(async_scheduler(L)->suspend(L));
+
+  exception_barrier(L,
+    [&]() {
+      forward_async_member<FP, fp, O, C, A...>(L, c,
+        std::make_index_sequence<sizeof...(A)>());
+
+      return 0;
+    }
+  );
+
+  return async_suspend(L, top);
 }
 
-template <std::size_t O, typename C, typename R, typename ...A,
-  std::size_t ...I>
-inline std::enable_if_t<bool(!sizeof...(A)), R>
-forward(lua_State* const, C* const c,
-  R (C::* const ptr_to_member)(A...) const,
-  std::index_sequence<I...> const) noexcept(
-  noexcept((c->*ptr_to_member)())
-)
+template <typename FP, FP fp, std::size_t O, class ...A>
+constexpr inline lua_CFunction async_func_stub(void (*)(completion, A...))
+  noexcept
 {
-  return (c->*ptr_to_member)();
+  return &async_func_stub<FP, fp, O, A...>;
 }
 
-template <std::size_t O, typename C, typename R, typename ...A,
-  std::size_t ...I>
-inline std::enable_if_t<bool(!sizeof...(A)), R>
-forward(lua_State* const, C* const c,
-  R (C::* const ptr_to_member)(A...),
-  std::index_sequence<I...> const) noexcept(
-  noexcept((c->*ptr_to_member)())
-)
+template <typename FP, FP fp, std::size_t O, class C, class ...A>
+constexpr inline lua_CFunction async_member_stub(
+  void (C::*)(completion, A...)) noexcept
 {
-  return (c->*ptr_to_member)();
+  return &async_member_stub<FP, fp, O, C, A...>;
 }
 
-template <std::size_t O, typename C, typename R, typename ...A,
-  std::size_t ...I>
-inline std::enable_if_t<bool(sizeof...(A)), R>
-forward(lua_State* const L, C* const c,
-  R (C::* const ptr_to_member)(A...) const,
-  std::index_sequence<I...> const) noexcept(
-  noexcept((c->*ptr_to_member)(get<I + O, A>(L)...))
-)
+template <typename FP, FP fp, std::size_t O, class C, class ...A>
+constexpr inline lua_CFunction async_member_stub(
+  void (C::*)(completion, A...) const) noexcept
 {
-  return (c->*ptr_to_member)(get<I + O, A>(L)...);
+  return &async_member_stub<FP, fp, O, C, A...>;
 }
 
-template <std::size_t O, typename C, typename R,
-  typename ...A, std::size_t ...I>
-inline std::enable_if_t<bool(sizeof...(A)), R>
-forward(lua_State* const L, C* const c,
-  R (C::* const ptr_to_member)(A...), std::index_sequence<I...> const)
-  noexcept(noexcept((c->*ptr_to_member)(get<I + O, A>(L)...)))
-{
-  return (c->*ptr_to_member)(get<I + O, A>(L)...);
-}
+class scope
+{
+public:
+  scope(char const* const name) : name_(name) { }
+
+  template <typename ...A>
+  scope(char const* const name, A&&... args) : name_(name)
+  {
+    swallow((args.set_parent_scope(this), 0)...);
+  }
+
+  scope(scope const&) = delete;
+
+  scope& operator=(scope const&) = delete;
+
+  template <typename T>
+  std::enable_if_t<
+    std::is_same<std::decay_t<T>, bool>{},
+    scope&
+  >
+  constant(char const* const name, T const value)
+  {
+    struct constant_info_type const ci {
+      BOOLEAN,
+      {value}
+    };
+
+    constants_.emplace_back(name, ci);
+
+    return *this;
+  }
+
+  template <typename T>
+  std::enable_if_t<
+    std::is_floating_point<std::decay_t<T>>{},
+    scope&
+  >
+  constant(char const* const name, T const value)
+  {
+    struct constant_info_type ci;
+    ci.type = NUMBER;
+    ci.u.number = value;
+
+    constants_.emplace_back(name, ci);
+
+    return *this;
+  }
+
+  template <typename T>
+  std::enable_if_t<
+    std::is_integral<std::decay_t<T>>{} &&
+    !std::is_same<std::decay_t<T>, bool>{},
+    scope&
+  >
+  constant(char const* const name, T const value)
+  {
+    struct constant_info_type ci;
+    ci.type = INTEGER;
+    ci.u.integer = value;
+
+    constants_.emplace_back(name, ci);
+
+    return *this;
+  }
+
+  scope& constant(char const* const name, char const* const value)
+  {
+    struct constant_info_type ci;
+    ci.type = STRING;
+    ci.u.string = value;
+
+    constants_.emplace_back(name, ci);
+
+    return *this;
+  }
+
+  template <typename FP, FP fp>
+  scope& def(char const* const name)
+  {
+    push_function<FP, fp>(name, fp);
+
+    return *this;
+  }
+
+  template <class F, class ...G>
+  scope& def(char const* const name)
+  {
+    static_assert(all_true<!F::is_member, !G::is_member...>{},
+      "member functions can not be overloads of a scope function");
+    functions_.push_back({name, overload_stub<1, F, G...>});
+
+    return *this;
+  }
+
+  scope& enum_(char const* const name, lua_Integer const value)
+  {
+    constant(name, value);
+
+    return *this;
+  }
+
+  template <typename FP, FP fp>
+  scope& vararg_def(char const* const name)
+  {
+    push_vararg_function<FP, fp>(name, fp);
+
+    return *this;
+  }
+
+  // the function takes a completion first and suspends the calling task
+  template <typename FP, FP fp>
+  scope& async_def(char const* const name)
+  {
+    functions_.push_back({name, async_func_stub<FP, fp, 1>(fp)});
+
+    return *this;
+  }
+
+protected:
+  virtual void apply(lua_State* const L)
+  {
+    struct S
+    {
+      static void push_constant(lua_State* const L,
+        decltype(constants_)::const_reference i)
+      {
+        switch (i.second.type)
+        {
+          default:
+            assert(0);
+
+          case BOOLEAN:
+            lua_pushboolean(L, i.second.u.boolean);
+
+            break;
+
+          case INTEGER:
+            lua_pushinteger(L, i.second.u.integer);
+
+            break;
+
+          case NUMBER:
+            lua_pushnumber(L, i.second.u.number);
+
+            break;
+
+          case STRING:
+            lua_pushstring(L, i.second.u.string);
+        }
+      }
+    };
+
+    {
+      stub_names n(L, name_);
+
+      for (auto& i: functions_)
+      {
+        n.add(i);
+      }
+    }
+
+    if (parent_scope_)
+    {
+      scope::get_scope(L);
+      assert(lua_istable(L, -1));
+
+      for (auto& i: constants_)
+      {
+        assert(lua_istable(L, -1));
+        S::push_constant(L, i);
+
+        rawsetfield(L, -2, i.first);
+      }
+
+      for (auto& i: functions_)
+      {
+        assert(lua_istable(L, -1));
+
+        lua_pushnil(L);
+
+        lua_pushcclosure(L, i.callback, 1);
+
+        rawsetfield(L, -2, i.name);
+      }
 
-template <typename FP, FP fp, std::size_t O, class C, class R, class ...A>
-inline std::enable_if_t<!std::is_void<R>{}, int>
-member_stub(lua_State* const L) noexcept(
-  noexcept(set(L,
-    forward<O, C, R, A...>(L,
-      static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2))),
-      fp,
-      std::make_index_sequence<sizeof...(A)>()))
-  )
-)
-{
-//std::cout << lua_gettop(L) << " " << sizeof...(A) + O - 1 << std::endl;
-  assert(sizeof...(A) + O - 1 == lua_gettop(L));
+      lua_pop(L, 1);
+    }
+    else
+    {
+      for (auto& i: constants_)
+      {
+        assert(lua_istable(L, -1));
+        S::push_constant(L, i);
 
-  return set(L,
-    forward<O, C, R, A...>(L,
-      static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2))),
-      fp,
-      std::make_index_sequence<sizeof...(A)>()));
-}
+        lua_setglobal(L, i.first);
+      }
 
-template <typename FP, FP fp, std::size_t O, class C, class R, class ...A>
-inline std::enable_if_t<std::is_void<R>{}, int>
-member_stub(lua_State* const L) noexcept(
-  noexcept(forward<O, C, R, A...>(L,
-    static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2))),
-    fp,
-    std::make_index_sequence<sizeof...(A)>())
-  )
-)
-{
-  assert(sizeof...(A) + O - 1 == lua_gettop(L));
+      for (auto& i: functions_)
+      {
+        lua_pushnil(L);
+        lua_pushcclosure(L, i.callback, 1);
 
-  forward<O, C, R, A...>(L,
-    static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2))),
-    fp,
-    std::make_index_sequence<sizeof...(A)>());
+        lua_setglobal(L, i.name);
+      }
 
-  return {};
-}
+      auto next(next_);
 
-template <typename FP, FP fp, class C, class R>
-inline std::enable_if_t<!std::is_void<R>{}, int>
-vararg_member_stub(lua_State* const L) noexcept(
-  noexcept(set(L, (static_cast<C*>(
-    lua_touserdata(L, lua_upvalueindex(2)))->*fp)(L))
-  )
-)
-{
-  return set(L,
-    (static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2)))->*fp)(L)
-  );
-}
+      while (next)
+      {
+        next->apply(L);
 
-template <typename FP, FP fp, class C, class R>
-inline std::enable_if_t<std::is_void<R>{}, int>
-vararg_member_stub(lua_State* const L) noexcept(
-  noexcept(
-    (static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2)))->*fp)(L)
-  )
-)
-{
-  (static_cast<C*>(lua_touserdata(L, lua_upvalueindex(2)))->*fp)(L);
+        next = next->next_;
+      }
+    }
 
-  return {};
-}
+    assert(!lua_gettop(L));
+  }
 
-template <typename FP, FP fp, std::size_t O, class R, class ...A>
-constexpr inline lua_CFunction func_stub(R (*)(A...)) noexcept
-{
-  return &func_stub<FP, fp, O, R, A...>;
-}
+  // the instance brings its own descendants along, which end at its tail
+  void append_child_scope(scope* const instance) noexcept
+  {
+    (next_ ? tail_->next_ : next_) = instance;
 
-template <typename FP, FP fp, std::size_t O, class R, class C, class ...A>
-constexpr inline lua_CFunction member_stub(R (C::*)(A...)) noexcept
-{
-  return &member_stub<FP, fp, O, C, R, A...>;
-}
+    tail_ = instance->tail_ ? instance->tail_ : instance;
+  }
 
-template <typename FP, FP fp, std::size_t O, class R, class C, class ...A>
-constexpr inline lua_CFunction member_stub(R (C::*)(A...) const) noexcept
-{
-  return &member_stub<FP, fp, O, C, R, A...>;
-}
+  void set_parent_scope(scope* const parent_scope)
+  {
+    parent_scope->append_child_scope(this);
 
-template <typename FP, FP fp, class R, class C>
-constexpr inline lua_CFunction vararg_member_stub(R (C::*)(lua_State*)) noexcept
-{
-  return &vararg_member_stub<FP, fp, C, R>;
-}
+    ++parent_scope->children_;
 
-template <typename FP, FP fp, class R, class C>
-constexpr inline lua_CFunction vararg_member_stub(R (C::*)(lua_State*) const) noexcept
-{
-  return &vararg_member_stub<FP, fp, C, R>;
-}
+    parent_scope_ = parent_scope;
+  }
 
-template <typename R>
-constexpr inline enum property_type get_property_type() noexcept
-{
-  if (std::is_same<std::decay_t<R>, bool>{})
+  // number of fields of the scope table
+  virtual std::size_t size() const noexcept
   {
-    return BOOLEAN;
+    return constants_.size() + functions_.size() + children_;
   }
-  else if (std::is_integral<R>{})
+
+  // the tables of nested scopes are kept in the registry while the module is
+  // being applied, so that finding one does not walk the path to it again
+  void get_scope(lua_State* const L)
   {
-    return INTEGER;
+    if (LUA_NOREF != ref_)
+    {
+      lua_rawgeti(L, LUA_REGISTRYINDEX, ref_);
+
+      return;
+    }
+    else if (parent_scope_)
+    {
+      assert(name_);
+      parent_scope_->get_scope(L);
+
+      if (scope_create_)
+      {
+        scope_create_ = false;
+
+        if (lua_gettop(L))
+        {
+          assert(lua_istable(L, -1));
+          lua_createtable(L, 0, int(size()));
+          lua_pushvalue(L, -1);
+          rawsetfield(L, -3, name_);
+          lua_remove(L, -2);
+        }
+        else
+        {
+          lua_createtable(L, 0, int(size()));
+          lua_pushvalue(L, -1);
+          lua_setglobal(L, name_);
+        }
+      }
+      else if (lua_gettop(L) && lua_istable(L, -1))
+      {
+        luaL_getsubtable(L, -1, name_);
+        lua_remove(L, -2);
+      }
+      else
+      {
+        lua_getglobal(L, name_);
+      }
+
+      lua_pushvalue(L, -1);
+      ref_ = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    else if (name_)
+    {
+      if (scope_create_)
+      {
+        scope_create_ = false;
+
+        lua_createtable(L, 0, int(size()));
+        lua_setglobal(L, name_);
+      }
+      // else do nothing
+
+      lua_getglobal(L, name_);
+    }
+    // else do nothing
   }
-  else if (std::is_floating_point<R>{})
+
+  void release_scopes(lua_State* const L) noexcept
   {
-    return NUMBER;
+    for (auto next(next_); next; next = next->next_)
+    {
+      luaL_unref(L, LUA_REGISTRYINDEX, next->ref_);
+
+      next->ref_ = LUA_NOREF;
+    }
   }
-  else if (std::is_same<R, std::string const&>{} ||
-    std::is_same<std::decay_t<R>, char const*>{})
+
+protected:
+  char const* const name_;
+
+  scope* parent_scope_{};
+
+  std::vector<func_info_type> functions_;
+
+private:
+  template <typename FP, FP fp, typename R, typename ...A>
+  void push_function(char const* const name, R (* const)(A...))
   {
-    return STRING;
+    functions_.push_back({name, func_stub<FP, fp, 1, R, A...>});
   }
-  else
+
+  template <typename FP, FP fp, typename R>
+  void push_vararg_function(char const* const name, R (* const)(lua_State*))
   {
-    return OTHER;
+    functions_.push_back({name, vararg_func_stub<FP, fp, R>});
   }
-}
 
-template <typename FP, FP fp, class R, class C, class ...A>
-constexpr inline auto get_property_type( R (C::* const)(A...)) noexcept
-{
-  return get_property_type<R>();
-}
+private:
+  friend class module;
 
-template <typename FP, FP fp, class R, class C, class ...A>
-constexpr inline auto get_property_type(R (C::* const)(A...) const) noexcept
-{
-  return get_property_type<R>();
-}
+  constants_type constants_;
 
-template <typename ...A>
-inline void call(lua_State* const L, int const nresults, A&& ...args)
-  noexcept(noexcept(swallow{(set(L, std::forward<A>(args)))...}))
-{
-  int ac{};
+  scope* next_{};
 
-  swallow{
-    (ac += set(L, std::forward<A>(args)))...
-  };
-  assert(ac >= int(sizeof...(A)));
+  scope* tail_{};
 
-  lua_call(L, ac, nresults);
-}
+  std::size_t children_{};
 
-class scope
+  int ref_{LUA_NOREF};
+
+  bool scope_create_{true};
+};
+
+class module : public scope
 {
-public:
-  scope(char const* const name) : name_(name) { }
+  lua_State* const L_;
+
+  // names the function on top, as scope::apply() names its functions
+  void name_function(char const* const name)
+  {
+    auto const f(lua_tocfunction(L_, -1));
+
+    stub_names(L_, name_).add(f, name);
+  }
 
+public:
   template <typename ...A>
-  scope(char const* const name, A&&... args) : name_(name)
+  module(lua_State* const L, A&&... args) :
+    scope(nullptr),
+    L_(L)
   {
     swallow((args.set_parent_scope(this), 0)...);
+
+    scope::apply(L);
+
+    release_scopes(L);
   }
 
-  scope(scope const&) = delete;
+  template <typename ...A>
+  module(lua_State* const L, char const* const name, A&&... args) :
+    scope(name),
+    L_(L)
+  {
+    swallow((args.set_parent_scope(this), 0)...);
 
-  scope& operator=(scope const&) = delete;
+    scope::apply(L);
+
+    release_scopes(L);
+  }
 
   template <typename T>
   std::enable_if_t<
     std::is_same<std::decay_t<T>, bool>{},
-    scope&
+    module&
   >
   constant(char const* const name, T const value)
   {
-    struct constant_info_type const ci {
-      BOOLEAN,
-      {value}
-    };
+    if (name_)
+    {
+      scope::get_scope(L_);
+      assert(lua_istable(L_, -1));
 
-    constants_.emplace_back(name, ci);
+      lua_pushboolean(L_, value);
+      rawsetfield(L_, -2, name);
+
+      lua_pop(L_, 1);
+    }
+    else
+    {
+      lua_pushboolean(L_, value);
+
+      lua_setglobal(L_, name);
+    }
 
     return *this;
   }
@@ -1366,15 +6332,26 @@ public:
   template <typename T>
   std::enable_if_t<
     std::is_floating_point<std::decay_t<T>>{},
-    scope&
+    module&
   >
   constant(char const* const name, T const value)
   {
-    struct constant_info_type ci;
-    ci.type = NUMBER;
-    ci.u.number = value;
+    if (name_)
+    {
+      scope::get_scope(L_);
+      assert(lua_istable(L_, -1));
 
-    constants_.emplace_back(name, ci);
+      lua_pushnumber(L_, value);
+      rawsetfield(L_, -2, name);
+
+      lua_pop(L_, 1);
+    }
+    else
+    {
+      lua_pushnumber(L_, value);
+
+      lua_setglobal(L_, name);
+    }
 
     return *this;
   }
@@ -1383,473 +6360,653 @@ public:
   std::enable_if_t<
     std::is_integral<std::decay_t<T>>{} &&
     !std::is_same<std::decay_t<T>, bool>{},
-    scope&
+    module&
   >
   constant(char const* const name, T const value)
   {
-    struct constant_info_type ci;
-    ci.type = INTEGER;
-    ci.u.integer = value;
+    if (name_)
+    {
+      scope::get_scope(L_);
+      assert(lua_istable(L_, -1));
 
-    constants_.emplace_back(name, ci);
+      lua_pushinteger(L_, value);
+      rawsetfield(L_, -2, name);
+
+      lua_pop(L_, 1);
+    }
+    else
+    {
+      lua_pushinteger(L_, value);
+
+      lua_setglobal(L_, name);
+    }
 
     return *this;
   }
 
-  scope& constant(char const* const name, char const* const value)
+  module& constant(char const* const name, char const* const value)
   {
-    struct constant_info_type ci;
-    ci.type = STRING;
-    ci.u.string = value;
+    if (name_)
+    {
+      scope::get_scope(L_);
+      assert(lua_istable(L_, -1));
 
-    constants_.emplace_back(name, ci);
+      lua_pushstring(L_, value);
+      rawsetfield(L_, -2, name);
+
+      lua_pop(L_, 1);
+    }
+    else
+    {
+      lua_pushstring(L_, value);
+
+      lua_setglobal(L_, name);
+    }
 
     return *this;
   }
 
   template <typename FP, FP fp>
-  scope& def(char const* const name)
+  module& def(char const* const name)
   {
-    push_function<FP, fp>(name, fp);
+    if (name_)
+    {
+      scope::get_scope(L_);
+      assert(lua_istable(L_, -1));
+
+      push_function<FP, fp>(fp);
+      name_function(name);
+
+      rawsetfield(L_, -2, name);
+
+      lua_pop(L_, 1);
+    }
+    else
+    {
+      push_function<FP, fp>(fp);
+      name_function(name);
+
+      lua_setglobal(L_, name);
+    }
 
     return *this;
   }
 
-  scope& enum_(char const* const name, lua_Integer const value)
+  template <class F, class ...G>
+  module& def(char const* const name)
   {
-    constant(name, value);
+    static_assert(all_true<!F::is_member, !G::is_member...>{},
+      "member functions can not be overloads of a module function");
+
+    if (name_)
+    {
+      scope::get_scope(L_);
+      assert(lua_istable(L_, -1));
+
+      lua_pushnil(L_);
+      lua_pushcclosure(L_, overload_stub<1, F, G...>, 1);
+      name_function(name);
+
+      rawsetfield(L_, -2, name);
+
+      lua_pop(L_, 1);
+    }
+    else
+    {
+      lua_pushnil(L_);
+      lua_pushcclosure(L_, overload_stub<1, F, G...>, 1);
+      name_function(name);
+
+      lua_setglobal(L_, name);
+    }
 
     return *this;
   }
 
+  module& enum_(char const* const name, int const value)
+  {
+    return constant(name, lua_Number(value));
+  }
+
   template <typename FP, FP fp>
-  scope& vararg_def(char const* const name)
+  module& async_def(char const* const name)
   {
-    push_vararg_function<FP, fp>(name, fp);
+    if (name_)
+    {
+      scope::get_scope(L_);
+      assert(lua_istable(L_, -1));
+
+      lua_pushnil(L_);
+      lua_pushcclosure(L_, async_func_stub<FP, fp, 1>(fp), 1);
+      name_function(name);
+
+      rawsetfield(L_, -2, name);
+
+      lua_pop(L_, 1);
+    }
+    else
+    {
+      lua_pushnil(L_);
+      lua_pushcclosure(L_, async_func_stub<FP, fp, 1>(fp), 1);
+      name_function(name);
+
+      lua_setglobal(L_, name);
+    }
 
     return *this;
   }
 
-protected:
-  virtual void apply(lua_State* const L)
+  template <typename FP, FP fp>
+  module& vararg_def(char const* const name)
   {
-    struct S
+    if (name_)
     {
-      static void push_constant(lua_State* const L,
-        decltype(constants_)::const_reference i)
-      {
-        switch (i.second.type)
-        {
-          default:
-            assert(0);
+      scope::get_scope(L_);
+      assert(lua_istable(L_, -1));
 
-          case BOOLEAN:
-            lua_pushboolean(L, i.second.u.boolean);
+      push_vararg_function<FP, fp>(fp);
+      name_function(name);
 
-            break;
+      rawsetfield(L_, -2, name);
 
-          case INTEGER:
-            lua_pushinteger(L, i.second.u.integer);
+      lua_pop(L_, 1);
+    }
+    else
+    {
+      push_vararg_function<FP, fp>(fp);
+      name_function(name);
 
-            break;
+      lua_setglobal(L_, name);
+    }
 
-          case NUMBER:
-            lua_pushnumber(L, i.second.u.number);
+    return *this;
+  }
 
-            break;
+private:
+  template <typename FP, FP fp, typename R, typename ...A>
+  void push_function(R (* const)(A...))
+  {
+    lua_pushnil(L_);
+    lua_pushcclosure(L_, func_stub<FP, fp, 1, R, A...>, 1);
+  }
 
-          case STRING:
-            lua_pushstring(L, i.second.u.string);
-        }
-      }
-    };
+  template <typename FP, FP fp, typename R>
+  void push_vararg_function(R (* const)(lua_State*))
+  {
+    lua_pushnil(L_);
+    lua_pushcclosure(L_, vararg_func_stub<FP, fp, R>, 1);
+  }
+};
 
-    if (parent_scope_)
-    {
-      scope::get_scope(L);
-      assert(lua_istable(L, -1));
+// runs init, upvalue 1 holds it
+inline int preload_init(lua_State* const L)
+{
+  auto const init(*static_cast<void (* const*)(lua_State*)>(
+    lua_touserdata(L, lua_upvalueindex(1))));
 
-      for (auto& i: constants_)
-      {
-        assert(lua_istable(L, -1));
-        S::push_constant(L, i);
+  return exception_barrier(L, [&]() { init(L); return 0; });
+}
 
-        rawsetfield(L, -2, i.first);
-      }
+// calls init, when the module is first required, with a new table in place
+// of the globals, that require() returns; upvalue 1 holds init
+inline int preload_loader(lua_State* const L)
+{
+  lua_settop(L, 0);
 
-      for (auto& i: functions_)
-      {
-        assert(lua_istable(L, -1));
+  lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
 
-        lua_pushnil(L);
+  // while init runs, the globals are read through the new table
+  lua_newtable(L);
+  lua_createtable(L, 0, 1);
+  lua_pushvalue(L, 1);
+  rawsetfield(L, -2, "__index");
+  lua_setmetatable(L, 2);
 
-        lua_pushcclosure(L, i.callback, 1);
+  lua_pushvalue(L, 2);
+  lua_rawseti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
 
-        rawsetfield(L, -2, i.name);
-      }
+  // the globals are restored, whether init fails or not
+  lua_pushvalue(L, lua_upvalueindex(1));
+  lua_pushcclosure(L, preload_init, 1);
 
-      lua_pop(L, 1);
-    }
-    else
-    {
-      for (auto& i: constants_)
-      {
-        assert(lua_istable(L, -1));
-        S::push_constant(L, i);
+  auto const status(lua_pcall(L, 0, 0, 0));
+
+  lua_pushvalue(L, 1);
+  lua_rawseti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+
+  lua_pushnil(L);
+  lua_setmetatable(L, 2);
+
+  return status ? lua_error(L) : 1;
+}
+
+// registers init as the package.preload loader of name; init applies the
+// bindings with a module without a name, whose globals become the fields
+// of the table require() returns, no globals are set
+inline void preload(lua_State* const L, char const* const name,
+  void (* const init)(lua_State*))
+{
+  luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_PRELOAD_TABLE);
+
+  *static_cast<void (**)(lua_State*)>(
+    lua_newuserdata(L, sizeof(init))) = init;
+
+  lua_pushcclosure(L, preload_loader, 1);
+
+  rawsetfield(L, -2, name);
+
+  lua_pop(L, 1);
+}
+
+using accessors_info_type = std::unordered_map<char const*,
+  unsigned,
+  str_hash,
+  str_eq
+>;
+
+using defs_type = std::vector<
+  std::pair<
+    std::vector<void* (*)(void*) noexcept>,
+    member_info_type
+  >
+>;
+
+// entries of descriptors
+template <typename T, typename ...A>
+constexpr inline std::array<T, 1 + sizeof...(A)> entries(T const& a,
+  A const& ...b) noexcept
+{
+  return {{a, b...}};
+}
 
-        lua_setglobal(L, i.first);
-      }
+template <class C, class ...A>
+constexpr inline func_info_type constructor(char const* const name)
+  noexcept
+{
+  return {name, constructor_stub<1, C, A...>};
+}
 
-      for (auto& i: functions_)
-      {
-        lua_pushnil(L);
-        lua_pushcclosure(L, i.callback, 1);
+template <class C, class ...A>
+constexpr inline func_info_type array_constructor(
+  char const* const name = "new_array") noexcept
+{
+  return {name, array_constructor_stub<C, A...>};
+}
 
-        lua_setglobal(L, i.name);
-      }
+template <typename FP, FP fp>
+constexpr inline member_info_type method(char const* const name) noexcept
+{
+  return {name, member_stub<FP, fp, 2>(fp)};
+}
 
-      auto next(next_);
+template <typename FP, FP fp>
+constexpr inline property_info_type property(char const* const name)
+  noexcept
+{
+  return {name, member_stub<FP, fp, 3>(fp), nullptr,
+    is_const_member_function<FP>{}};
+}
 
-      while (next)
-      {
-        next->apply(L);
+template <typename FPA, FPA fpa, typename FPB, FPB fpb>
+constexpr inline property_info_type property(char const* const name)
+  noexcept
+{
+  return {name, member_stub<FPA, fpa, 3>(fpa), member_stub<FPB, fpb, 3>(fpb),
+    is_const_member_function<FPA>{}};
+}
 
-        next = next->next_;
-      }
-    }
+template <typename T>
+constexpr inline std::enable_if_t<
+  std::is_same<T, bool>{},
+  described_constant_type
+>
+constant(char const* const name, T const value) noexcept
+{
+  return {name, BOOLEAN, value, {}, {}};
+}
 
-    assert(!lua_gettop(L));
-  }
+template <typename T>
+constexpr inline std::enable_if_t<
+  std::is_floating_point<T>{},
+  described_constant_type
+>
+constant(char const* const name, T const value) noexcept
+{
+  return {name, NUMBER, {}, static_cast<lua_Number>(value), {}};
+}
 
-  void append_child_scope(scope* const instance)
-  {
-    if (next_)
-    {
-      auto next(next_);
+template <typename T>
+constexpr inline std::enable_if_t<
+  std::is_integral<T>{} &&
+  !std::is_same<T, bool>{},
+  described_constant_type
+>
+constant(char const* const name, T const value) noexcept
+{
+  return {name, INTEGER, static_cast<lua_Integer>(value), {}, {}};
+}
 
-      while (next->next_)
-      {
-        next = next->next_;
-      }
+constexpr inline described_constant_type constant(char const* const name,
+  char const* const value) noexcept
+{
+  return {name, STRING, {}, {}, value};
+}
 
-      next->next_ = instance;
-    }
-    else
-    {
-      next_ = instance;
-    }
-  }
+// a class bound through its descriptor, instead of the statics of class_;
+// nothing is allocated at startup, but inheritance is not supported
+template <class C>
+class described_class : public scope
+{
+  static_assert(is_described<C>{}, "is_described is not specialized");
 
-  void set_parent_scope(scope* const parent_scope)
+public:
+  explicit described_class(char const* const name) : scope(name)
   {
-    parent_scope->append_child_scope(this);
+  }
 
-    parent_scope_ = parent_scope;
+private:
+  std::size_t size() const noexcept
+  {
+    return scope::size() +
+      described_constructors<C>().size() +
+      described_constants<C>().size();
   }
 
-  void get_scope(lua_State* const L)
+  void apply(lua_State* const L)
   {
-    if (parent_scope_)
+    assert(parent_scope_);
+    scope::apply(L);
+
     {
-      assert(name_);
-      parent_scope_->get_scope(L);
+      stub_names n(L, name_);
 
-      if (scope_create_)
+      for (auto& i: described_constructors<C>())
       {
-        scope_create_ = false;
-
-        if (lua_gettop(L))
-        {
-          assert(lua_istable(L, -1));
-          lua_createtable(L, 0, default_nrec);
-          rawsetfield(L, -2, name_);
-        }
-        else
-        {
-          lua_createtable(L, 0, default_nrec);
-          lua_setglobal(L, name_);
-        }
+        n.add(i);
       }
-      // else do nothing
 
-      if (lua_gettop(L) && lua_istable(L, -1))
-      {
-        luaL_getsubtable(L, -1, name_);
-        lua_remove(L, -2);
-      }
-      else
+      for (auto& i: described_methods<C>())
       {
-        lua_getglobal(L, name_);
+        n.add(i);
       }
+
+      n.add(getter<C>, "__index");
+      n.add(setter<C>, "__newindex");
     }
-    else if (name_)
+
+    scope::get_scope(L);
+    assert(lua_istable(L, -1));
+
+    for (auto& i: described_constants<C>())
     {
-      if (scope_create_)
+      assert(lua_istable(L, -1));
+
+      switch (i.type)
       {
-        scope_create_ = false;
+        default:
+          assert(0);
 
-        lua_createtable(L, 0, default_nrec);
-        lua_setglobal(L, name_);
-      }
-      // else do nothing
+        case BOOLEAN:
+          lua_pushboolean(L, i.integer);
 
-      lua_getglobal(L, name_);
-    }
-    // else do nothing
-  }
+          break;
 
-protected:
-  char const* const name_;
+        case INTEGER:
+          lua_pushinteger(L, i.integer);
 
-  scope* parent_scope_{};
+          break;
 
-  std::vector<func_info_type> functions_;
+        case NUMBER:
+          lua_pushnumber(L, i.number);
 
-private:
-  template <typename FP, FP fp, typename R, typename ...A>
-  void push_function(char const* const name, R (* const)(A...))
-  {
-    functions_.push_back({name, func_stub<FP, fp, 1, R, A...>});
-  }
+          break;
 
-  template <typename FP, FP fp, typename R>
-  void push_vararg_function(char const* const name, R (* const)(lua_State*))
-  {
-    functions_.push_back({name, vararg_func_stub<FP, fp, R>});
-  }
+        case STRING:
+          lua_pushstring(L, i.string);
+      }
 
-private:
-  friend class module;
+      rawsetfield(L, -2, i.name);
+    }
 
-  constants_type constants_;
+    for (auto& i: described_constructors<C>())
+    {
+      assert(lua_istable(L, -1));
+      lua_pushcfunction(L, i.callback);
 
-  scope* next_{};
+      rawsetfield(L, -2, i.name);
+    }
 
-  bool scope_create_{true};
+    lua_pop(L, 1);
+
+    assert(!lua_gettop(L));
+  }
 };
 
-class module : public scope
+// upvalue 2 is rewritten, and an error may leave it stale, so the object
+// is kept in upvalue 1, on the first call; wrapper tables of returned
+// objects are then not cached there
+inline void* batch_object(lua_State* const L) noexcept
 {
-  lua_State* const L_;
-
-public:
-  template <typename ...A>
-  module(lua_State* const L, A&&... args) :
-    scope(nullptr),
-    L_(L)
+  if (auto const p = lua_touserdata(L, lua_upvalueindex(1)))
   {
-    swallow((args.set_parent_scope(this), 0)...);
+    return p;
+  }
+  else
+  {
+    lua_pushvalue(L, lua_upvalueindex(2));
+    lua_replace(L, lua_upvalueindex(1));
 
-    scope::apply(L);
+    return lua_touserdata(L, lua_upvalueindex(1));
   }
+}
 
-  template <typename ...A>
-  module(lua_State* const L, char const* const name, A&&... args) :
-    scope(name),
-    L_(L)
+// obj:get("a", "b") returns the values of properties a and b, each name is
+// replaced by its value
+template <class C>
+int batch_get(lua_State* const L)
+{
+  auto const p(batch_object(L));
+
+  if (!p)
   {
-    swallow((args.set_parent_scope(this), 0)...);
+    return dead_object(L);
+  }
+  // else do nothing
 
-    scope::apply(L);
+  auto const n(lua_gettop(L));
+
+  if (n < 2)
+  {
+    return {};
   }
+  // else do nothing
 
-  template <typename T>
-  std::enable_if_t<
-    std::is_same<std::decay_t<T>, bool>{},
-    module&
-  >
-  constant(char const* const name, T const value)
+  for (int i(2); i <= n; ++i)
   {
-    if (name_)
+    if (auto const a = LUA_TSTRING == lua_type(L, i) ?
+      find_getter<C>(lua_tostring(L, i)) :
+      nullptr)
     {
-      scope::get_scope(L_);
-      assert(lua_istable(L_, -1));
-
-      lua_pushboolean(L_, value);
-      rawsetfield(L_, -2, name);
-
-      lua_pop(L_, 1);
+      call_getter(L, *a, p, i);
     }
     else
     {
-      lua_pushboolean(L_, value);
-
-      lua_setglobal(L_, name);
+      lua_pushnil(L);
+      lua_replace(L, i);
     }
-
-    return *this;
   }
 
-  template <typename T>
-  std::enable_if_t<
-    std::is_floating_point<std::decay_t<T>>{},
-    module&
-  >
-  constant(char const* const name, T const value)
-  {
-    if (name_)
-    {
-      scope::get_scope(L_);
-      assert(lua_istable(L_, -1));
-
-      lua_pushnumber(L_, value);
-      rawsetfield(L_, -2, name);
+  return n - 1;
+}
 
-      lua_pop(L_, 1);
-    }
-    else
-    {
-      lua_pushnumber(L_, value);
+// obj:set{a = 1, b = 2} sets properties a and b
+template <class C>
+int batch_set(lua_State* const L)
+{
+  luaL_checktype(L, 2, LUA_TTABLE);
 
-      lua_setglobal(L_, name);
-    }
+  auto const p(batch_object(L));
 
-    return *this;
+  if (!p)
+  {
+    return dead_object(L);
   }
+  // else do nothing
 
-  template <typename T>
-  std::enable_if_t<
-    std::is_integral<std::decay_t<T>>{} &&
-    !std::is_same<std::decay_t<T>, bool>{},
-    module&
-  >
-  constant(char const* const name, T const value)
+  // self, t, value, key
+  lua_settop(L, 3);
+
+  lua_pushnil(L);
+
+  while (lua_next(L, 2))
   {
-    if (name_)
-    {
-      scope::get_scope(L_);
-      assert(lua_istable(L_, -1));
+    auto const a(LUA_TSTRING == lua_type(L, 4) ?
+      find_setter<C>(lua_tostring(L, 4)) :
+      nullptr);
 
-      lua_pushinteger(L_, value);
-      rawsetfield(L_, -2, name);
+    lua_replace(L, 3);
 
-      lua_pop(L_, 1);
-    }
-    else
+    if (a)
     {
-      lua_pushinteger(L_, value);
+      prepare_accessor(L, *a, p);
 
-      lua_setglobal(L_, name);
-    }
+      std::get<1>(*a)(L);
 
-    return *this;
+      lua_settop(L, 4);
+    }
+    // else do nothing
   }
 
-  module& constant(char const* const name, char const* const value)
+  return {};
+}
+
+// a list of properties of C, resolved once; pushed as a function, f(obj)
+// returns the properties of obj, f(obj, ...) sets them, obj must have been
+// created as a C
+template <class C>
+class accessor_plan
+{
+  std::vector<
+    std::pair<accessor_type const*, accessor_type const*>
+  > accessors_;
+
+public:
+  accessor_plan(std::initializer_list<char const*> const names)
   {
-    if (name_)
+    accessors_.reserve(names.size());
+
+    for (auto const name: names)
     {
-      scope::get_scope(L_);
-      assert(lua_istable(L_, -1));
+      accessors_.emplace_back(find_getter<C>(name), find_setter<C>(name));
+    }
+  }
+
+  auto const& accessors() const noexcept { return accessors_; }
+};
+
+template <class C>
+int plan_stub(lua_State* const L)
+{
+  void* p{};
 
-      lua_pushstring(L_, value);
-      rawsetfield(L_, -2, name);
+  if (lua_getmetatable(L, 1))
+  {
+    rawgetfield(L, -1, "__wrap");
 
-      lua_pop(L_, 1);
-    }
-    else
+    if ((wrap_stub<C> == lua_tocfunction(L, -1)) &&
+      lua_getupvalue(L, -1, 2))
     {
-      lua_pushstring(L_, value);
+      p = lua_touserdata(L, -1);
 
-      lua_setglobal(L_, name);
+      lua_pop(L, 1);
     }
+    // else do nothing
 
-    return *this;
+    lua_pop(L, 2);
   }
+  // else do nothing
 
-  template <typename FP, FP fp>
-  module& def(char const* const name)
-  {
-    if (name_)
-    {
-      scope::get_scope(L_);
-      assert(lua_istable(L_, -1));
+  luaL_argcheck(L, p, 1,
+    is_described<C>{} ? "object" : lualite::class_<C>::class_name());
 
-      push_function<FP, fp>(fp);
+  auto const n(lua_gettop(L));
 
-      rawsetfield(L_, -2, name);
+  // upvalue 1 holds the getters and setters, upvalue 2 is rewritten
+  auto const uvi(lua_upvalueindex(1));
 
-      lua_pop(L_, 1);
-    }
-    else
-    {
-      push_function<FP, fp>(fp);
+  using pair_type = std::pair<accessor_type const*, accessor_type const*>;
 
-      lua_setglobal(L_, name);
-    }
+  auto const a(static_cast<pair_type const*>(lua_touserdata(L, uvi)));
 
-    return *this;
-  }
+  auto const k(int(lua_rawlen(L, uvi) / sizeof(pair_type)));
 
-  module& enum_(char const* const name, int const value)
+  if (1 == n)
   {
-    return constant(name, lua_Number(value));
-  }
+    // obj, nil, the values
+    luaL_checkstack(L, k + 1, "too many properties");
 
-  template <typename FP, FP fp>
-  module& vararg_def(char const* const name)
-  {
-    if (name_)
+    lua_pushnil(L);
+
+    for (int i{}; i != k; ++i)
     {
-      scope::get_scope(L_);
-      assert(lua_istable(L_, -1));
+      lua_pushnil(L);
 
-      push_vararg_function<FP, fp>(fp);
+      if (a[i].first)
+      {
+        call_getter(L, *a[i].first, p, lua_gettop(L));
+      }
+      // else do nothing
+    }
 
-      rawsetfield(L_, -2, name);
+    return k;
+  }
+  else if (k + 1 == n)
+  {
+    // obj, nil, value, the values
+    luaL_checkstack(L, 2, "too many properties");
 
-      lua_pop(L_, 1);
-    }
-    else
+    lua_pushnil(L);
+    lua_pushnil(L);
+    lua_rotate(L, 2, 2);
+
+    for (int i{}; i != k; ++i)
     {
-      push_vararg_function<FP, fp>(fp);
+      if (a[i].second)
+      {
+        lua_copy(L, i + 4, 3);
 
-      lua_setglobal(L_, name);
+        prepare_accessor(L, *a[i].second, p);
+
+        std::get<1>(*a[i].second)(L);
+
+        lua_settop(L, n + 2);
+      }
+      // else do nothing
     }
 
-    return *this;
+    return {};
   }
-
-private:
-  template <typename FP, FP fp, typename R, typename ...A>
-  void push_function(R (* const)(A...))
+  else
   {
-    lua_pushnil(L_);
-    lua_pushcclosure(L_, func_stub<FP, fp, 1, R, A...>, 1);
+    return luaL_error(L, "expected 1 or %d arguments", k + 1);
   }
+}
 
-  template <typename FP, FP fp, typename R>
-  void push_vararg_function(R (* const)(lua_State*))
-  {
-    lua_pushnil(L_);
-    lua_pushcclosure(L_, vararg_func_stub<FP, fp, R>, 1);
-  }
-};
+template <class C>
+inline int set(lua_State* const L, accessor_plan<C> const& v)
+{
+  auto const& a(v.accessors());
 
-using accessor_type = std::tuple<
-  std::vector<void* (*)(void*) noexcept>,
-  map_member_info_type,
-  enum property_type
->;
+  auto const size(sizeof(a.front()) * a.size());
 
-using accessors_type = std::unordered_map<char const*,
-  accessor_type,
-  str_hash,
-  str_eq
->;
+  std::memcpy(lua_newuserdata(L, size), a.data(), size);
 
-using accessors_info_type = std::unordered_map<char const*,
-  unsigned,
-  str_hash,
-  str_eq
->;
+  lua_pushnil(L);
 
-using defs_type = std::vector<
-  std::pair<
-    std::vector<void* (*)(void*) noexcept>,
-    member_info_type
-  >
->;
+  lua_pushcclosure(L, plan_stub<C>, 2);
+
+  return 1;
+}
 
 template <class C>
 class class_ : public scope
@@ -1865,10 +7022,20 @@ class class_ : public scope
   static accessors_type getters_;
   static accessors_type setters_;
 
+  // getters, that are const member functions, for shared data
+  static accessors_type const_getters_;
+
 public:
+  // the description of a class is kept in static members; it may be
+  // repeated, by every state the class is applied to, the repeated entries
+  // are skipped, so repeating it only reads the static members
   class_(char const* const name) : scope(name)
   {
-    class_name_ = name;
+    if (!class_name_ || std::strcmp(class_name_, name))
+    {
+      class_name_ = name;
+    }
+    // else do nothing
   }
 
   template <typename T>
@@ -1887,31 +7054,60 @@ public:
   template <class ...A>
   class_& constructor(char const* const name = "new")
   {
-    constructors_.push_back({name, constructor_stub<1, C, A...>});
+    add_constructor(name, constructor_stub<1, C, A...>);
 
     return *this;
   }
 
-  template <class ...A>
-  class_& inherits()
+  // recycles the storage of the instances lua constructs, keeping at most
+  // cap free blocks per thread, see object_pool
+  class_& pool(std::size_t const cap = 1024)
   {
-    swallow{
-      (S<A>::copy_accessors(class_<A>::getters(), getters_), 0)...
-    };
+    object_pool<C>::enable(cap);
 
-    swallow{
-      (S<A>::copy_accessors(class_<A>::setters(), setters_), 0)...
-    };
+    return *this;
+  }
 
-    swallow{
-      (S<A>::copy_defs(class_<A>::defs(), defs_), 0)...
-    };
+  template <class ...A>
+  class_& array_constructor(char const* const name = "new_array")
+  {
+    add_constructor(name, array_constructor_stub<C, A...>);
 
-    assert(inherits_.empty());
-    inherits_.reserve(sizeof...(A));
-    swallow{
-      (inherits_.push_back(class_<A>::inherits), 0)...
-    };
+    return *this;
+  }
+
+  template <class ...A>
+  class_& inherits()
+  {
+    if (inherits_.empty())
+    {
+      swallow{
+        (S<A>::copy_accessors(class_<A>::getters(), getters_), 0)...
+      };
+
+      swallow{
+        (S<A>::copy_accessors(class_<A>::setters(), setters_), 0)...
+      };
+
+      swallow{
+        (S<A>::copy_accessors(class_<A>::const_getters(), const_getters_),
+          0)...
+      };
+
+      swallow{
+        (S<A>::copy_defs(class_<A>::defs(), defs_), 0)...
+      };
+
+      inherits_.reserve(sizeof...(A));
+      swallow{
+        (inherits_.push_back(class_<A>::inherits), 0)...
+      };
+    }
+    else
+    {
+      // a repeated description inherits the same classes
+      assert(inherits_ == decltype(inherits_){class_<A>::inherits...});
+    }
 
     return *this;
   }
@@ -1924,6 +7120,8 @@ public:
 
   static auto const& setters() noexcept { return setters_; }
 
+  static auto const& const_getters() noexcept { return const_getters_; }
+
   auto getters_info() const
   {
     accessors_info_type r;
@@ -1989,15 +7187,33 @@ public:
   >
   def(char const* const name)
   {
-    defs_.push_back(
-      {
-        {},
-        member_info_type {
-          name,
-          member_stub<FP, fp, 2>(fp)
-        }
-      }
-    );
+    add_def(name, member_stub<FP, fp, 2>(fp));
+
+    return *this;
+  }
+
+  template <class F, class ...G>
+  std::enable_if_t<
+    !F::is_member,
+    class_&
+  >
+  def(char const* const name)
+  {
+    scope::def<F, G...>(name);
+
+    return *this;
+  }
+
+  template <class F, class ...G>
+  std::enable_if_t<
+    F::is_member,
+    class_&
+  >
+  def(char const* const name)
+  {
+    static_assert(all_true<G::is_member...>{},
+      "free functions can not be overloads of a member function");
+    add_def(name, overload_stub<2, F, G...>);
 
     return *this;
   }
@@ -2009,15 +7225,7 @@ public:
   >
   def_func(char const* const name)
   {
-    defs_.push_back(
-      {
-        {},
-        member_info_type {
-          name,
-          member_stub<FP, fp, 1>(fp)
-        }
-      }
-    );
+    add_def(name, member_stub<FP, fp, 1>(fp));
 
     return *this;
   }
@@ -2029,15 +7237,7 @@ public:
   >
   def_func(char const* const name)
   {
-    defs_.push_back(
-      {
-        {},
-        member_info_type {
-          name,
-          func_stub<FP, fp, 1>(fp)
-        }
-      }
-    );
+    add_def(name, func_stub<FP, fp, 1>(fp));
 
     return *this;
   }
@@ -2052,15 +7252,7 @@ public:
   template <class FP, FP fp>
   auto& property(char const* const name)
   {
-    getters_.emplace(name,
-      accessors_type::mapped_type {
-        {},
-        member_stub<FP, fp, 3>(fp),
-        get_property_type<FP, fp>(fp)
-      }
-    );
-
-    assert(std::get<1>(getters_[name]));
+    add_getter<FP, fp>(name);
 
     return *this;
   }
@@ -2068,25 +7260,30 @@ public:
   template <typename FPA, FPA fpa, typename FPB, FPB fpb>
   auto& property(char const* const name)
   {
-    getters_.emplace(name,
-      accessors_type::mapped_type {
-        {},
-        member_stub<FPA, fpa, 3>(fpa),
-        get_property_type<FPA, fpa>(fpa)
-      }
-    );
+    add_getter<FPA, fpa>(name);
 
-    assert(std::get<1>(getters_[name]));
+    if (!setters_.count(name))
+    {
+      setters_.emplace(name,
+        accessors_type::mapped_type {
+          {},
+          member_stub<FPB, fpb, 3>(fpb),
+          get_property_type<FPA, fpa>(fpa)
+        }
+      );
+    }
+    // else do nothing
 
-    setters_.emplace(name,
-      accessors_type::mapped_type {
-        {},
-        member_stub<FPB, fpb, 3>(fpb),
-        get_property_type<FPA, fpa>(fpa)
-      }
-    );
+    return *this;
+  }
 
-    assert(std::get<1>(setters_[name]));
+  // obj:get("a", "b") and obj:set{a = 1, b = 2}, any number of properties
+  // in one call
+  class_& batch(char const* const get = "get",
+    char const* const set = "set")
+  {
+    add_def(get, batch_get<C>);
+    add_def(set, batch_set<C>);
 
     return *this;
   }
@@ -2098,20 +7295,90 @@ public:
   >
   vararg_def(char const* const name)
   {
-    defs_.push_back(
-      {
-        {},
-        member_info_type {
-          name,
-          vararg_member_stub<FP, fp>(fp)
-        }
-      }
-    );
+    add_def(name, vararg_member_stub<FP, fp>(fp));
+
+    return *this;
+  }
+
+  template <typename FP, FP fp>
+  std::enable_if_t<
+    is_function_pointer<FP>{},
+    class_&
+  >
+  async_def(char const* const name)
+  {
+    scope::async_def<FP, fp>(name);
+
+    return *this;
+  }
+
+  template <typename FP, FP fp>
+  std::enable_if_t<
+    !is_function_pointer<FP>{},
+    class_&
+  >
+  async_def(char const* const name)
+  {
+    add_def(name, async_member_stub<FP, fp, 2>(fp));
 
     return *this;
   }
 
 private:
+  static void add_constructor(char const* const name,
+    lua_CFunction const f)
+  {
+    for (auto& c: constructors_)
+    {
+      if ((f == c.callback) && !std::strcmp(name, c.name))
+      {
+        return;
+      }
+      // else do nothing
+    }
+
+    constructors_.push_back({name, f});
+  }
+
+  // inherited methods are not compared
+  static void add_def(char const* const name, lua_CFunction const f)
+  {
+    for (auto& d: defs_)
+    {
+      if (d.first.empty() && (f == d.second.callback) &&
+        !std::strcmp(name, d.second.name))
+      {
+        return;
+      }
+      // else do nothing
+    }
+
+    defs_.push_back({{}, member_info_type {name, f}});
+  }
+
+  // the first getter of a name is kept
+  template <class FP, FP fp>
+  static void add_getter(char const* const name)
+  {
+    if (!getters_.count(name))
+    {
+      auto const& g(getters_.emplace(name,
+        accessors_type::mapped_type {
+          {},
+          member_stub<FP, fp, 3>(fp),
+          get_property_type<FP, fp>(fp)
+        }
+      ).first->second);
+
+      if (is_const_member_function<FP>{})
+      {
+        const_getters_.emplace(name, g);
+      }
+      // else do nothing
+    }
+    // else do nothing
+  }
+
   template <class A>
   struct S
   {
@@ -2141,11 +7408,33 @@ private:
     }
   };
 
+  std::size_t size() const noexcept
+  {
+    return scope::size() + constructors_.size();
+  }
+
   void apply(lua_State* const L)
   {
     assert(parent_scope_);
     scope::apply(L);
 
+    {
+      stub_names n(L, name_);
+
+      for (auto& i: constructors_)
+      {
+        n.add(i);
+      }
+
+      for (auto& i: defs_)
+      {
+        n.add(i.second);
+      }
+
+      n.add(getter<C>, "__index");
+      n.add(setter<C>, "__newindex");
+    }
+
     scope::get_scope(L);
     assert(lua_istable(L, -1));
 
@@ -2158,8 +7447,19 @@ private:
     }
 
     assert(inherits_.capacity() == inherits_.size());
-    constructors_.shrink_to_fit();
-    defs_.shrink_to_fit();
+
+    // repeated applications only read the description
+    if (constructors_.capacity() != constructors_.size())
+    {
+      constructors_.shrink_to_fit();
+    }
+    // else do nothing
+
+    if (defs_.capacity() != defs_.size())
+    {
+      defs_.shrink_to_fit();
+    }
+    // else do nothing
 
     lua_pop(L, 1);
 
@@ -2191,6 +7491,9 @@ accessors_type class_<C>::getters_;
 template <class C>
 accessors_type class_<C>::setters_;
 
+template <class C>
+accessors_type class_<C>::const_getters_;
+
 } // lualite
 
 #endif // LUALITE_HPP
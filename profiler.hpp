@@ -0,0 +1,330 @@
+/*
+** This is free and unencumbered software released into the public domain.
+
+** Anyone is free to copy, modify, publish, use, compile, sell, or
+** distribute this software, either in source code form or as a compiled
+** binary, for any purpose, commercial or non-commercial, and by any
+** means.
+
+** In jurisdictions that recognize copyright laws, the author or authors
+** of this software dedicate any and all copyright interest in the
+** software to the public domain. We make this dedication for the benefit
+** of the public at large and to the detriment of our heirs and
+** successors. We intend this dedication to be an overt act of
+** relinquishment in perpetuity of all present and future rights to this
+** software under copyright law.
+
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+** OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+** ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+** OTHER DEALINGS IN THE SOFTWARE.
+
+** For more information, please refer to <http://unlicense.org/>
+*/
+
+#ifndef LUALITE_PROFILER_HPP
+# define LUALITE_PROFILER_HPP
+# pragma once
+
+#include <chrono>
+
+#include <cstdint>
+
+#include <mutex>
+
+#include <string>
+
+#include <unordered_map>
+
+#include "lualite.hpp"
+
+namespace lualite
+{
+
+// a sampling profiler of a state; a sample is due every interval, it is
+// taken at the next count hook, run every count instructions, or at the
+// next entry or exit of a stub. The samples are counted per stack of lua
+// functions and stubs. Stubs bound while a profiler is attached, or after
+// name_stubs(), are named as they were bound, the others as lua calls them.
+// The hook of the state is replaced and restored on detach, coroutines
+// created while the profiler is attached inherit it.
+class profiler
+{
+  using clock = std::chrono::steady_clock;
+
+  lua_State* const L_;
+
+  clock::duration const interval_;
+
+  clock::time_point due_;
+
+  std::unordered_map<std::string, std::size_t> stacks_;
+
+  std::string stack_;
+
+  lua_Hook const hook_;
+
+  int const mask_;
+
+  int const count_;
+
+  static void const* key() noexcept
+  {
+    static char const k{};
+
+    return &k;
+  }
+
+  static profiler* of(lua_State* const L) noexcept
+  {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, key());
+
+    auto const p(static_cast<profiler*>(lua_touserdata(L, -1)));
+
+    lua_pop(L, 1);
+
+    return p;
+  }
+
+  // the stub hook is shared by all profilers
+  static auto& attached() noexcept
+  {
+    static std::pair<std::mutex, std::size_t> a;
+
+    return a;
+  }
+
+  static void count_hook(lua_State* const L, lua_Debug*) noexcept
+  {
+    if (auto const p = of(L))
+    {
+      auto const now(clock::now());
+
+      if (now >= p->due_)
+      {
+        p->due_ = now + p->interval_;
+
+        p->sample(L, 0, 1);
+      }
+      // else do nothing
+    }
+    // else do nothing
+  }
+
+  // stubs are entered from a lua function, that was running until then; the
+  // samples due, when a stub returns, were due while it ran; the hook is
+  // called in every state, those without the count hook are skipped before
+  // the registry is read
+  static void stub_hook(lua_State* const L, int const level) noexcept
+  {
+    if (auto const p = count_hook == lua_gethook(L) ? of(L) : nullptr)
+    {
+      auto const now(clock::now());
+
+      if (now >= p->due_)
+      {
+        if (level)
+        {
+          p->due_ = now + p->interval_;
+
+          p->sample(L, level, 1);
+        }
+        else
+        {
+          std::size_t const n(1 + (now - p->due_) / p->interval_);
+
+          p->due_ += n * p->interval_;
+
+          p->sample(L, level, n);
+        }
+      }
+      // else do nothing
+    }
+    // else do nothing
+  }
+
+  // frames can't contain the separator of folded stacks
+  void append(char const* s)
+  {
+    for (; *s; ++s)
+    {
+      stack_.push_back((';' == *s) || ('\n' == *s) ? '_' : *s);
+    }
+  }
+
+  // the function of the frame and the stub names are on top
+  void append_frame(lua_State* const L, lua_Debug const& ar)
+  {
+    if (auto const f = lua_tocfunction(L, -1))
+    {
+      lua_pushcfunction(L, f);
+      lua_rawget(L, -3);
+
+      append(lua_isstring(L, -1) ? lua_tostring(L, -1) :
+        ar.name ? ar.name : "?");
+
+      lua_pop(L, 1);
+    }
+    else
+    {
+      append(*ar.what == 'm' ? "main chunk" : ar.name ? ar.name : "?");
+
+      stack_.append(" (");
+      append(ar.short_src);
+
+      if (ar.linedefined > 0)
+      {
+        stack_.push_back(':');
+        stack_.append(std::to_string(ar.linedefined));
+      }
+      // else do nothing
+
+      stack_.push_back(')');
+    }
+  }
+
+  // counts n samples of the stack, from the outermost frame to the one at
+  // level
+  void sample(lua_State* const L, int const level, std::size_t const n)
+    noexcept
+  {
+    // stubs may have used the stack, that was guaranteed to them; the
+    // names, the function of a frame and its name are pushed
+    if (!lua_checkstack(L, 3))
+    {
+      return;
+    }
+    // else do nothing
+
+    auto const top(lua_gettop(L));
+
+    try
+    {
+      lua_Debug ar;
+
+      auto depth(level);
+
+      while (lua_getstack(L, depth, &ar))
+      {
+        ++depth;
+      }
+
+      lua_rawgetp(L, LUA_REGISTRYINDEX, stub_names_key());
+
+      stack_.clear();
+
+      for (auto i(depth - 1); i >= level; --i)
+      {
+        lua_getstack(L, i, &ar);
+        lua_getinfo(L, "Snf", &ar);
+
+        append_frame(L, ar);
+
+        lua_pop(L, 1);
+
+        if (i != level)
+        {
+          stack_.push_back(';');
+        }
+        // else do nothing
+      }
+
+      stacks_[stack_] += n;
+    }
+    catch (...)
+    {
+      // the sample is lost
+    }
+
+    lua_settop(L, top);
+  }
+
+public:
+  explicit profiler(lua_State* const L,
+    std::chrono::microseconds const interval = std::chrono::microseconds(1000),
+    int const count = 1000) :
+    L_(L),
+    interval_(interval),
+    due_(clock::now() + interval_),
+    hook_(lua_gethook(L)),
+    mask_(lua_gethookmask(L)),
+    count_(lua_gethookcount(L))
+  {
+    name_stubs(L);
+
+    lua_pushlightuserdata(L, this);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, key());
+
+    lua_sethook(L, count_hook, LUA_MASKCOUNT, count);
+
+    auto& a(attached());
+
+    std::lock_guard<std::mutex> l(a.first);
+
+    if (!a.second++)
+    {
+      lualite::stub_hook() = stub_hook;
+    }
+    // else do nothing
+  }
+
+  profiler(profiler const&) = delete;
+
+  profiler& operator=(profiler const&) = delete;
+
+  ~profiler() noexcept
+  {
+    {
+      auto& a(attached());
+
+      std::lock_guard<std::mutex> l(a.first);
+
+      if (!--a.second)
+      {
+        lualite::stub_hook() = nullptr;
+      }
+      // else do nothing
+    }
+
+    lua_sethook(L_, hook_, mask_, count_);
+
+    lua_pushnil(L_);
+    lua_rawsetp(L_, LUA_REGISTRYINDEX, key());
+  }
+
+  // stubs bound from now on are named, profilers attached later report them
+  // as they were bound
+  static void name_stubs(lua_State* const L)
+  {
+    push_stub_names(L);
+    lua_pop(L, 1);
+  }
+
+  // the number of samples of every stack, frames are separated by ';'
+  auto const& samples() const noexcept { return stacks_; }
+
+  void clear() noexcept { stacks_.clear(); }
+
+  // one "stack count" line per stack, as flame graph tools expect
+  std::string folded() const
+  {
+    std::string r;
+
+    for (auto& s: stacks_)
+    {
+      r.append(s.first);
+      r.push_back(' ');
+      r.append(std::to_string(s.second));
+      r.push_back('\n');
+    }
+
+    return r;
+  }
+};
+
+}
+
+#endif // LUALITE_PROFILER_HPP
@@ -0,0 +1,521 @@
+/*
+** This is free and unencumbered software released into the public domain.
+
+** Anyone is free to copy, modify, publish, use, compile, sell, or
+** distribute this software, either in source code form or as a compiled
+** binary, for any purpose, commercial or non-commercial, and by any
+** means.
+
+** In jurisdictions that recognize copyright laws, the author or authors
+** of this software dedicate any and all copyright interest in the
+** software to the public domain. We make this dedication for the benefit
+** of the public at large and to the detriment of our heirs and
+** successors. We intend this dedication to be an overt act of
+** relinquishment in perpetuity of all present and future rights to this
+** software under copyright law.
+
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+** OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+** ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+** OTHER DEALINGS IN THE SOFTWARE.
+
+** For more information, please refer to <http://unlicense.org/>
+*/
+
+
+#ifndef LUALITE_SERIALIZE_HPP
+# define LUALITE_SERIALIZE_HPP
+# pragma once
+
+#include <cstdint>
+
+#include <cstring>
+
+#include <unordered_map>
+
+#include "lualite.hpp"
+
+namespace lualite
+{
+
+// the format is a flags byte followed by the value; values are a tag byte
+// and a payload: zigzag varint integers, doubles in host byte order,
+// varint length prefixed strings and tables, as varint array and record
+// sizes followed by the array elements and the key value pairs; tables
+// seen before are varint ordinals
+namespace serial
+{
+
+enum tag : unsigned char
+{
+  NIL,
+  BOOLEAN_FALSE,
+  BOOLEAN_TRUE,
+  INTEGER,
+  NUMBER,
+  STRING,
+  TABLE,
+  REFERENCE
+};
+
+enum flags : unsigned char
+{
+  REFERENCES = 1
+};
+
+// record sizes are written after the records, padded to a fixed width
+static constexpr std::size_t const padded_size = 5;
+
+static constexpr unsigned const max_depth = 200;
+
+template <typename B>
+class encoder
+{
+  B& b_;
+
+  std::size_t const start_;
+
+  std::unordered_map<void const*, std::uint64_t> tables_;
+
+  unsigned depth_{};
+
+  void put(char const c) { b_.push_back(c); }
+
+  void put_varint(std::uint64_t v)
+  {
+    char d[10];
+
+    std::size_t n{};
+
+    for (; v >= 0x80; v >>= 7)
+    {
+      d[n++] = char(v | 0x80);
+    }
+
+    d[n++] = char(v);
+
+    b_.insert(b_.end(), d, d + n);
+  }
+
+  void put_table(lua_State* const L, int const i)
+  {
+    auto const r(tables_.emplace(lua_topointer(L, i), tables_.size()));
+
+    if (!r.second)
+    {
+      b_[start_] |= REFERENCES;
+
+      put(REFERENCE);
+      put_varint(r.first->second);
+
+      return;
+    }
+    else if ((max_depth == depth_) || !lua_checkstack(L, 3))
+    {
+      throw error("cannot serialize, table nested too deeply");
+    }
+    // else do nothing
+
+    ++depth_;
+
+    auto const narr(lua_rawlen(L, i));
+
+    put(TABLE);
+    put_varint(narr);
+
+    auto const h(b_.size());
+
+    b_.insert(b_.end(), padded_size, char(0x80));
+
+    for (lua_Integer j{1}; lua_Unsigned(j) <= narr; ++j)
+    {
+      lua_rawgeti(L, i, j);
+
+      put_value(L, lua_gettop(L));
+
+      lua_pop(L, 1);
+    }
+
+    std::uint32_t nrec{};
+
+    lua_pushnil(L);
+
+    while (lua_next(L, i))
+    {
+      auto const top(lua_gettop(L));
+
+      if (!lua_isinteger(L, -2) ||
+        (lua_tointeger(L, -2) < 1) ||
+        (lua_Unsigned(lua_tointeger(L, -2)) > narr))
+      {
+        put_value(L, top - 1);
+        put_value(L, top);
+
+        ++nrec;
+      }
+      // else do nothing
+
+      lua_pop(L, 1);
+    }
+
+    for (std::size_t j{}; j != padded_size; ++j, nrec >>= 7)
+    {
+      b_[h + j] = char((nrec & 0x7f) | (j + 1 == padded_size ? 0 : 0x80));
+    }
+
+    --depth_;
+  }
+
+public:
+  explicit encoder(B& b) :
+    b_(b),
+    start_(b.size())
+  {
+    put(0);
+  }
+
+  void put_value(lua_State* const L, int const i)
+  {
+    switch (lua_type(L, i))
+    {
+      case LUA_TNIL:
+        put(NIL);
+
+        break;
+
+      case LUA_TBOOLEAN:
+        put(lua_toboolean(L, i) ? BOOLEAN_TRUE : BOOLEAN_FALSE);
+
+        break;
+
+      case LUA_TNUMBER:
+        if (lua_isinteger(L, i))
+        {
+          auto const v(std::uint64_t(lua_tointeger(L, i)));
+
+          put(INTEGER);
+          put_varint((v << 1) ^ (std::uint64_t(0) - (v >> 63)));
+        }
+        else
+        {
+          auto const v(lua_tonumber(L, i));
+
+          char d[sizeof(v)];
+
+          std::memcpy(d, &v, sizeof(v));
+
+          put(NUMBER);
+          b_.insert(b_.end(), d, d + sizeof(v));
+        }
+
+        break;
+
+      case LUA_TSTRING:
+        {
+          std::size_t l;
+
+          auto const s(lua_tolstring(L, i, &l));
+
+          put(STRING);
+          put_varint(l);
+
+          b_.insert(b_.end(), s, s + l);
+        }
+
+        break;
+
+      case LUA_TTABLE:
+        put_table(L, i);
+
+        break;
+
+      default:
+        throw error(lua_pushfstring(L, "cannot serialize a %s",
+          luaL_typename(L, i)));
+    }
+  }
+};
+
+class decoder
+{
+  char const* p_;
+
+  char const* const end_;
+
+  int seen_{};
+
+  lua_Integer n_{};
+
+  unsigned depth_{};
+
+  [[noreturn]] static void malformed()
+  {
+    throw error("cannot deserialize, malformed data");
+  }
+
+  unsigned char get()
+  {
+    if (end_ == p_)
+    {
+      malformed();
+    }
+    // else do nothing
+
+    return *p_++;
+  }
+
+  std::uint64_t get_varint()
+  {
+    std::uint64_t v{};
+
+    for (unsigned s{}; s < 64; s += 7)
+    {
+      auto const c(get());
+
+      v |= std::uint64_t(c & 0x7f) << s;
+
+      if (!(c & 0x80))
+      {
+        return v;
+      }
+      // else do nothing
+    }
+
+    malformed();
+  }
+
+  std::size_t get_size()
+  {
+    auto const n(get_varint());
+
+    if (n > std::size_t(end_ - p_))
+    {
+      malformed();
+    }
+    // else do nothing
+
+    return n;
+  }
+
+public:
+  decoder(char const* const data, std::size_t const size) noexcept :
+    p_(data),
+    end_(data + size)
+  {
+  }
+
+  auto position() const noexcept { return p_; }
+
+  void get_flags(lua_State* const L)
+  {
+    if (get() & REFERENCES)
+    {
+      lua_newtable(L);
+      seen_ = lua_gettop(L);
+    }
+    // else do nothing
+  }
+
+  void get_value(lua_State* const L)
+  {
+    switch (get())
+    {
+      case NIL:
+        lua_pushnil(L);
+
+        break;
+
+      case BOOLEAN_FALSE:
+        lua_pushboolean(L, false);
+
+        break;
+
+      case BOOLEAN_TRUE:
+        lua_pushboolean(L, true);
+
+        break;
+
+      case INTEGER:
+        {
+          auto const v(get_varint());
+
+          lua_pushinteger(L,
+            lua_Integer((v >> 1) ^ (std::uint64_t(0) - (v & 1))));
+        }
+
+        break;
+
+      case NUMBER:
+        {
+          lua_Number v;
+
+          if (std::size_t(end_ - p_) < sizeof(v))
+          {
+            malformed();
+          }
+          // else do nothing
+
+          std::memcpy(&v, p_, sizeof(v));
+          p_ += sizeof(v);
+
+          lua_pushnumber(L, v);
+        }
+
+        break;
+
+      case STRING:
+        {
+          auto const l(get_size());
+
+          lua_pushlstring(L, p_, l);
+          p_ += l;
+        }
+
+        break;
+
+      case TABLE:
+        {
+          // every element takes at least a byte
+          auto const narr(get_size());
+
+          auto const nrec(get_size());
+
+          if ((max_depth == depth_) || !lua_checkstack(L, 3) ||
+            (2 * nrec > std::size_t(end_ - p_)))
+          {
+            malformed();
+          }
+          // else do nothing
+
+          ++depth_;
+
+          lua_createtable(L, size_hint(narr), size_hint(nrec));
+
+          if (seen_)
+          {
+            lua_pushvalue(L, -1);
+            lua_rawseti(L, seen_, ++n_);
+          }
+          // else do nothing
+
+          for (lua_Integer i{1}; std::size_t(i) <= narr; ++i)
+          {
+            get_value(L);
+
+            if (lua_isnil(L, -1))
+            {
+              lua_pop(L, 1);
+            }
+            else
+            {
+              lua_rawseti(L, -2, i);
+            }
+          }
+
+          for (auto i(nrec); i; --i)
+          {
+            get_value(L);
+            get_value(L);
+
+            // nil and nan keys would make lua_rawset raise an error
+            if (lua_isnil(L, -2) ||
+              ((LUA_TNUMBER == lua_type(L, -2)) &&
+              (lua_tonumber(L, -2) != lua_tonumber(L, -2))))
+            {
+              malformed();
+            }
+            // else do nothing
+
+            lua_rawset(L, -3);
+          }
+
+          --depth_;
+        }
+
+        break;
+
+      case REFERENCE:
+        {
+          auto const i(get_varint());
+
+          if (!seen_ || (i >= std::uint64_t(n_)))
+          {
+            malformed();
+          }
+          // else do nothing
+
+          lua_rawgeti(L, seen_, lua_Integer(i) + 1);
+        }
+
+        break;
+
+      default:
+        malformed();
+    }
+  }
+
+  int seen() const noexcept { return seen_; }
+};
+
+}
+
+// appends the value at index to the buffer, a container of char, such as
+// std::string or std::vector<char>; metatables are not serialized
+template <typename B>
+inline void serialize(lua_State* const L, int index, B& buffer)
+{
+  index = lua_absindex(L, index);
+
+  auto const top(lua_gettop(L));
+
+  auto const size(buffer.size());
+
+  try
+  {
+    serial::encoder<B>(buffer).put_value(L, index);
+  }
+  catch (...)
+  {
+    lua_settop(L, top);
+    buffer.resize(size);
+
+    throw;
+  }
+}
+
+// pushes the value serialized at the start of the data, returns the number
+// of bytes read
+inline std::size_t deserialize(lua_State* const L, char const* const data,
+  std::size_t const size)
+{
+  auto const top(lua_gettop(L));
+
+  serial::decoder d(data, size);
+
+  try
+  {
+    d.get_flags(L);
+    d.get_value(L);
+  }
+  catch (...)
+  {
+    lua_settop(L, top);
+
+    throw;
+  }
+
+  if (auto const seen = d.seen())
+  {
+    lua_remove(L, seen);
+  }
+  // else do nothing
+
+  return d.position() - data;
+}
+
+}
+
+#endif // LUALITE_SERIALIZE_HPP
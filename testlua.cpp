@@ -1,7 +1,27 @@
+#include <algorithm>
+
+#include <chrono>
+
 #include <cstdlib>
 
+#include <cstring>
+
+#include <functional>
+
 #include <iostream>
 
+#include <limits>
+
+#include <map>
+
+#include <set>
+
+#if defined(__unix__) || defined(__APPLE__)
+# include <dirent.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif // __unix__ || __APPLE__
+
 extern "C" {
 
 #include "lua/lualib.h"
@@ -10,52 +30,37 @@ extern "C" {
 
 #include "lualite/lualite.hpp"
 
+#include "lualite/bytecode.hpp"
+
+#include "lualite/channel.hpp"
+
+#include "lualite/executor.hpp"
+
+#include "lualite/profiler.hpp"
+
+#include "lualite/serialize.hpp"
+
 struct point
 {
   int x;
   int y;
 };
 
-inline int set(lua_State* const L, point p)
+namespace lualite
 {
-  using namespace ::lualite;
-
-  lua_createtable(L, 2, 0);
-
-  lua_pushliteral(L, "x");
-  set(L, const_cast<decltype(p.x) const&>(p.x));
-  assert(lua_istable(L, -3));
-  lua_rawset(L, -3);
 
-  lua_pushliteral(L, "y");
-  set(L, const_cast<decltype(p.y) const&>(p.y));
-  assert(lua_istable(L, -3));
-  lua_rawset(L, -3);
-
-  return 1;
-}
-
-template <std::size_t I, typename T>
-inline std::enable_if_t<
-  ::std::is_same<T, point>{}, point
->
-get(lua_State* const L)
+template <>
+struct struct_<point>
 {
-  using namespace ::lualite;
-
-  assert(lua_istable(L, I));
-
-  struct point p;
-
-  lua_pushliteral(L, "x");
-  lua_rawget(L, -2);
-  p.x = lua_tointeger(L, -1);
-
-  lua_pushliteral(L, "y");
-  lua_rawget(L, -2);
-  p.y = lua_tointeger(L, -1);
+  static constexpr auto fields() noexcept
+  {
+    return std::make_tuple(
+      field("x", &point::x),
+      field("y", &point::y)
+    );
+  }
+};
 
-  return p;
 }
 
 point testfunc(int i, int j, int k)
@@ -78,6 +83,301 @@ void testtuple(std::tuple<char const*, char const*, int> const& p)
     << " third: " << std::get<2>(p) << std::endl;
 }
 
+// the overloads tell which of them ran
+int pick(int)
+{
+  return 1;
+}
+
+int pick(char const*)
+{
+  return 2;
+}
+
+int pick(int, int)
+{
+  return 3;
+}
+
+// an expected-like result
+struct halved
+{
+  using value_type = int;
+
+  int v;
+
+  char const* e;
+
+  bool has_value() const noexcept
+  {
+    return !e;
+  }
+
+  int operator*() const noexcept
+  {
+    return v;
+  }
+
+  char const* error() const noexcept
+  {
+    return e;
+  }
+};
+
+halved half(int const i)
+{
+  return i % 2 ? halved{0, "odd"} : halved{i / 2, nullptr};
+}
+
+#if __cplusplus >= 201703L
+std::optional<int> twice(std::optional<int> const i)
+{
+  return i ? std::optional<int>(*i * 2) : std::nullopt;
+}
+#endif // __cplusplus
+
+int fail(int)
+{
+  throw std::runtime_error("thrown");
+}
+
+int call_once(lualite::function_ref<int(int)> const f, int const i)
+{
+  return f(i);
+}
+
+std::function<int(int)> stored;
+
+void store(std::function<int(int)> f)
+{
+  stored = std::move(f);
+}
+
+struct record
+{
+  int n;
+
+  int get_n() const
+  {
+    return n;
+  }
+};
+
+template <typename T>
+lualite::shared<T> share(T v)
+{
+  return std::make_shared<T const>(std::move(v));
+}
+
+auto const shared_numbers(share(std::vector<int>{1, 2, 3}));
+
+auto const shared_index(
+  share(std::map<std::string, std::vector<int> >{{"a", {1, 2}}}));
+
+auto const shared_names(share(std::set<std::string>{"x", "y"}));
+
+auto const shared_small(share(std::map<signed char, int>{{1, 10}}));
+
+auto const shared_records(share(std::vector<record>{{5}}));
+
+lualite::shared<std::vector<int> > get_shared_numbers()
+{
+  return shared_numbers;
+}
+
+lualite::shared<std::map<std::string, std::vector<int> > >
+get_shared_index()
+{
+  return shared_index;
+}
+
+lualite::shared<std::set<std::string> > get_shared_names()
+{
+  return shared_names;
+}
+
+lualite::shared<std::map<signed char, int> > get_shared_small()
+{
+  return shared_small;
+}
+
+lualite::shared<std::vector<record> > get_shared_records()
+{
+  return shared_records;
+}
+
+struct vec
+{
+  int x_{}, y_{};
+
+  int x() const
+  {
+    return x_;
+  }
+
+  int y() const
+  {
+    return y_;
+  }
+
+  void set_x(int const v)
+  {
+    x_ = v;
+  }
+
+  void set_y(int const v)
+  {
+    y_ = v;
+  }
+
+  int sum() const
+  {
+    return x_ + y_;
+  }
+};
+
+#if (__cplusplus >= 201703L) && (LUA_VERSION_NUM >= 504)
+bool scratched(std::pmr::string const& s)
+{
+  return std::pmr::get_default_resource() != s.get_allocator().resource();
+}
+
+bool copied(std::pmr::string const s)
+{
+  return std::pmr::get_default_resource() != s.get_allocator().resource();
+}
+
+bool nested(std::pmr::vector<std::pmr::string> const& v,
+  lualite::function_ref<bool()> const f)
+{
+  return f() && (2 == v.size()) && ("b" == v.back()) &&
+    scratched(v.back());
+}
+
+std::size_t thrown(std::pmr::string const& s)
+{
+  throw std::runtime_error(std::string(s));
+}
+#endif // __cplusplus, LUA_VERSION_NUM
+
+struct extent
+{
+  int x{}, y{};
+
+  extent() = default;
+
+  extent(int const i, int const j) : x(i), y(j) { }
+
+  int get_x() const { return x; }
+  int get_y() const { return y; }
+
+  void set_x(int const v) { x = v; }
+  void set_y(int const v) { y = v; }
+
+  int sum() const { return x + y; }
+};
+
+namespace lualite
+{
+
+template <>
+struct descriptor<extent> : descriptor_base
+{
+  static constexpr auto constructors() noexcept
+  {
+    return entries(constructor<extent>("new"),
+      constructor<extent, int, int>("make"));
+  }
+
+  static constexpr auto methods() noexcept
+  {
+    return entries(method<LLFUNC(extent::sum)>("sum"),
+      member_info_type{"get", batch_get<extent>});
+  }
+
+  // out of order, the index sorts them
+  static constexpr auto properties() noexcept
+  {
+    return entries(
+      property<LLFUNC(extent::get_y), LLFUNC(extent::set_y)>("y"),
+      property<LLFUNC(extent::sum)>("total"),
+      property<LLFUNC(extent::get_x), LLFUNC(extent::set_x)>("x"));
+  }
+
+  static constexpr auto constants() noexcept
+  {
+    return entries(constant("dims", 2), constant("kind", "extent"));
+  }
+};
+
+template <>
+struct is_described<extent> : std::true_type { };
+
+}
+
+int inits;
+
+void init_halving(lua_State* const L)
+{
+  ++inits;
+
+  lualite::module(L)
+    .def<LLFUNC(half)>("halve");
+
+  // the globals are read through the table of the module
+  if (luaL_dostring(L, "assert(string.rep and halve) kind = \"halving\""))
+  {
+    throw std::runtime_error(lua_tostring(L, -1));
+  }
+  // else do nothing
+}
+
+void init_failing(lua_State*)
+{
+  throw std::runtime_error("init");
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+// the files of the directory, with their inodes and sizes
+std::map<std::string, std::pair<ino_t, off_t>> files(std::string const& d)
+{
+  std::map<std::string, std::pair<ino_t, off_t>> r;
+
+  if (auto const dir = ::opendir(d.c_str()))
+  {
+    while (auto const e = ::readdir(dir))
+    {
+      struct ::stat st;
+
+      auto const name(d + '/' + e->d_name);
+
+      if (!::stat(name.c_str(), &st) && S_ISREG(st.st_mode))
+      {
+        r.emplace(name, std::make_pair(st.st_ino, st.st_size));
+      }
+      // else do nothing
+    }
+
+    ::closedir(dir);
+  }
+  // else do nothing
+
+  return r;
+}
+
+lua_Integer cached_run(lualite::bytecode_cache const& c, lua_State* const L,
+  char const* const source)
+{
+  c.run(L, source, "=cached");
+
+  auto const r(lua_tointeger(L, -1));
+
+  lua_settop(L, 0);
+
+  return r;
+}
+#endif // __unix__ || __APPLE__
+
 struct testbase
 {
   std::string dummy(std::string msg)
@@ -152,6 +452,215 @@ private:
   std::string s_;
 };
 
+struct item : testbase
+{
+  int i;
+
+  item(int const j) : i(j)
+  {
+  }
+
+  int value() const
+  {
+    return i;
+  }
+};
+
+struct pooled
+{
+  static int live;
+
+  int i;
+
+  pooled(int const j) : i(j)
+  {
+    if (j < 0)
+    {
+      throw std::invalid_argument("negative");
+    }
+    // else do nothing
+
+    ++live;
+  }
+
+  ~pooled()
+  {
+    --live;
+  }
+
+  int value() const
+  {
+    return i;
+  }
+};
+
+int pooled::live;
+
+struct counted
+{
+  static int live;
+
+  counted()
+  {
+    ++live;
+  }
+
+  ~counted()
+  {
+    --live;
+  }
+
+  int value() const
+  {
+    return 7;
+  }
+
+  counted* self()
+  {
+    return this;
+  }
+
+  counted& same()
+  {
+    return *this;
+  }
+};
+
+int counted::live;
+
+std::vector<int> numbers{1, 2, 3};
+
+auto get_numbers()
+{
+  return lualite::range(numbers);
+}
+
+std::map<std::string, int> ages{{"a", 1}, {"b", 2}};
+
+auto get_ages()
+{
+  return lualite::range(ages);
+}
+
+auto count_to(int const n)
+{
+  return lualite::generator([i = 0, j = 0, n]() mutable {
+      return i < n ? (j = ++i, &j) : nullptr;
+    }
+  );
+}
+
+// a hook the profiler must restore
+void hook(lua_State*, lua_Debug*)
+{
+}
+
+// busy for 100 microseconds, long enough to be sampled
+void spin()
+{
+  auto const end(std::chrono::steady_clock::now() +
+    std::chrono::microseconds(100));
+
+  while (std::chrono::steady_clock::now() < end);
+}
+
+struct enemy
+{
+  lualite::weak_handle<enemy> const handle{
+    lualite::weak_handle<enemy>::attach(this)};
+
+  int hp{10};
+
+  ~enemy()
+  {
+    handle.detach();
+  }
+
+  int health() const
+  {
+    return hp;
+  }
+};
+
+lualite::weak_handle<enemy> boss;
+
+lualite::weak_handle<enemy> find_boss()
+{
+  return boss;
+}
+
+struct fragile
+{
+  static int live;
+
+  // constructions left, before one throws
+  static int budget;
+
+  int i{};
+
+  fragile()
+  {
+    if (!budget--)
+    {
+      throw std::runtime_error("budget");
+    }
+    // else do nothing
+
+    ++live;
+  }
+
+  ~fragile()
+  {
+    --live;
+  }
+
+  int get_i() const { return i; }
+
+  void set_i(int const v) { i = v; }
+
+  int twice() const { return 2 * i; }
+};
+
+int fragile::live;
+
+int fragile::budget{1000};
+
+std::vector<point> points{{1, 2}, {3, 4}, {5, 6}};
+
+lualite::columns<point> get_points()
+{
+  return lualite::columns<point>(points);
+}
+
+std::vector<lualite::completion> pending;
+
+void later(lualite::completion c, int)
+{
+  pending.push_back(c);
+}
+
+void complete_and_throw(lualite::completion c)
+{
+  c(1);
+
+  throw std::runtime_error("thrown after completion");
+}
+
+bool check(lua_State* const L, char const* const chunk)
+{
+  if (luaL_dostring(L, chunk))
+  {
+    std::cerr << "check failed: " << lua_tostring(L, -1) << std::endl;
+    lua_pop(L, 1);
+
+    return false;
+  }
+  else
+  {
+    return true;
+  }
+}
+
 int main(int argc, char* argv[])
 {
   lua_State* L(luaL_newstate());
@@ -169,8 +678,10 @@ int main(int argc, char* argv[])
       .constructor<int>()
       .inherits<testbase>() // you can add more classes to inherit from
       .enum_("smell", 9)
-      .def<std::tuple<int, std::string, char const*> (testclass::*)(int), &testclass::print>("print")
-      .def<std::vector<std::string> (testclass::*)(std::string) const, &testclass::print>("print_")
+      .def<
+        lualite::overload<std::tuple<int, std::string, char const*> (testclass::*)(int), &testclass::print>,
+        lualite::overload<std::vector<std::string> (testclass::*)(std::string) const, &testclass::print>
+      >("print")
       .def<LLFUNC(testclass::pointer)>("pointer")
       .def<LLFUNC(testclass::reference)>("reference")
       .property<LLFUNC(testclass::a), LLFUNC(testclass::set_a)>("a")
@@ -181,8 +692,10 @@ int main(int argc, char* argv[])
         .constructor<int>()
         .enum_("smell", 10)
         .def<LLFUNC(testfunc)>("testfunc")
-        .def<std::tuple<int, std::string, char const*> (testclass::*)(int), &testclass::print>("print")
-        .def<std::vector<std::string> (testclass::*)(std::string) const, &testclass::print>("print_")
+        .def<
+          lualite::overload<std::tuple<int, std::string, char const*> (testclass::*)(int), &testclass::print>,
+          lualite::overload<std::vector<std::string> (testclass::*)(std::string) const, &testclass::print>
+        >("print")
     )
   }
   .enum_("apple", 1)
@@ -211,11 +724,11 @@ int main(int argc, char* argv[])
     "print(b.a .. \" \" .. b:dummy(\"test\"))\n"
     "local tmp1, tmp2, tmp3 = b:pointer():print(100)\n"
     "print(tmp1 .. \" \" .. tmp2 .. \" \" .. tmp3)\n"
-    "b:reference():print_(\"msg1\")\n"
+    "b:reference():print(\"msg1\")\n"
     "local a = subscope.testclass.new(1111)\n"
     "print(subscope.testclass.smell)\n"
     "subscope.testclass.testfunc(200, 0, 1)\n"
-    "local c = a:reference():print_(\"msg2\")\n"
+    "local c = a:reference():print(\"msg2\")\n"
     "print(c[10])\n"
     "r = {}"
     "for i = 1, 10 do\n"
@@ -235,7 +748,764 @@ int main(int argc, char* argv[])
     ::lualite::hash("test") <<
     ::std::endl;
 
+  bool ok(true);
+
+  lualite::module(L)
+    .def<
+      lualite::overload<int (*)(int), &pick>,
+      lualite::overload<int (*)(char const*), &pick>,
+      lualite::overload<int (*)(int, int), &pick>
+    >("pick");
+
+  // overloads are selected by arity and by lua type, members too
+  ok = check(L,
+    "assert(pick(7) == 1 and pick(\"s\") == 2 and pick(1, 2) == 3)\n"
+    "local ok, e = pcall(pick, true)\n"
+    "assert(not ok and e:find(\"no matching overload\"))\n"
+    "assert(not pcall(pick, 1, 2, 3) and not pcall(pick))\n"
+    "local b = testclass.new(1)\n"
+    "assert(b:print(1) == 9 and b:print(\"s\")[10] == \"bla!!!\")\n"
+    "assert(not pcall(b.print, b, {}))\n"
+  ) && ok;
+
+  lualite::module(L)
+    .def<LLFUNC(half)>("half")
+#if __cplusplus >= 201703L
+    .def<LLFUNC(twice)>("twice")
+#endif // __cplusplus
+    .def<LLFUNC(fail)>("fail");
+
+  // expected-like results are returned as value or nil, error, exceptions
+  // are raised as lua errors
+  ok = check(L,
+    "local v, e = half(4)\n"
+    "assert(v == 2 and e == nil)\n"
+    "v, e = half(3)\n"
+    "assert(v == nil and e == \"odd\")\n"
+    "local ok, e = pcall(fail, 1)\n"
+    "assert(not ok and e:find(\"thrown\"))\n"
+  ) && ok;
+
+#if __cplusplus >= 201703L
+  ok = check(L,
+    "assert(twice(2) == 4 and twice(nil) == nil and not twice())") && ok;
+#endif // __cplusplus
+
+  lualite::module(L)
+    .def<LLFUNC(call_once)>("call_once")
+    .def<LLFUNC(store)>("store");
+
+  // errors raised by callbacks are thrown, the stubs raise them again
+  ok = check(L,
+    "assert(call_once(function(i) return i + 1 end, 1) == 2)\n"
+    "local ok, e = pcall(call_once, function() error(\"cb\") end, 1)\n"
+    "assert(not ok and e:find(\"cb\"))\n"
+    "weak = setmetatable({}, {__mode = \"v\"})\n"
+    "local f = function(i) if i < 0 then error(\"negative\") end "
+      "return i * 3 end\n"
+    "weak[1] = f\n"
+    "store(f)\n"
+  ) && ok;
+
+  ok = (6 == stored(2)) && ok;
+
+  try
+  {
+    stored(-1);
+
+    ok = false;
+  }
+  catch (lualite::error const&)
+  {
+  }
+
+  // the last copy of the function releases its reference
+  {
+    auto const copy(stored);
+
+    stored = nullptr;
+
+    ok = check(L, "collectgarbage() assert(weak[1])") && (3 == copy(1)) &&
+      ok;
+  }
+
+  ok = check(L, "collectgarbage() assert(not weak[1]) weak = nil") && ok;
+
+  {
+    lualite::scheduler s(L);
+
+    lualite::module(L)
+      .async_def<LLFUNC(later)>("later")
+      .async_def<LLFUNC(complete_and_throw)>("complete_and_throw");
+
+    ok = check(L,
+      "order = {}\n"
+      "function task(i)\n"
+      "  local r = later(i)\n"
+      "  order[#order + 1] = r\n"
+      "end\n"
+      "function failing()\n"
+      "  complete_and_throw()\n"
+      "end\n"
+      "assert(not pcall(later, 1))\n"
+    ) && ok;
+
+    for (int i(1); i <= 3; ++i)
+    {
+      lua_getglobal(L, "task");
+      lua_pushinteger(L, i);
+      s.spawn(1);
+    }
+
+    ok = (3 == s.run()) && (3 == pending.size()) && ok;
+
+    for (auto i(pending.crbegin()); i != pending.crend(); ++i)
+    {
+      (*i)(int(pending.crend() - i) * 10);
+    }
+
+    ok = !pending.front()(0) && !s.run() && ok;
+    pending.clear();
+
+    lua_getglobal(L, "failing");
+    s.spawn(0);
+
+    try
+    {
+      s.run();
+
+      ok = false;
+    }
+    catch (lualite::error const&)
+    {
+    }
+
+    ok = !s.run() && check(L,
+      "assert(#order == 3)\n"
+      "assert(order[1] == 30 and order[2] == 20 and order[3] == 10)\n"
+    ) && ok;
+  }
+
+  {
+    lualite::executor ex([](lua_State* const L) {
+        lualite::module{L,
+          lualite::class_<item>("item")
+            .constructor<int>()
+            .inherits<testbase>()
+            .def<LLFUNC(item::value)>("value")
+        };
+
+        luaL_dostring(L,
+          "function twice(i) return item.new(i):value() * 2 end");
+      },
+      4
+    );
+
+    std::vector<std::future<int> > f;
+
+    for (int i{}; i != 100; ++i)
+    {
+      f.push_back(ex.submit<int>("twice", i));
+    }
+
+    for (int i{}; i != 100; ++i)
+    {
+      ok = (2 * i == f[i].get()) && ok;
+    }
+  }
+
+  // every worker applied item, the repeated descriptions were skipped
+  ok = (2 == lualite::class_<item>::defs().size()) && ok;
+
+  // later descriptions still add to the class
+  lualite::module{L,
+    lualite::class_<item>("item")
+      .constructor<int>()
+      .def<LLFUNC(item::value)>("value")
+      .def<LLFUNC(item::value)>("get")
+  };
+
+  ok = (3 == lualite::class_<item>::defs().size()) &&
+    check(L, "assert(item.new(2):get() == 2)") && ok;
+
+  try
+  {
+    lualite::executor ex([](lua_State*) {
+        throw std::runtime_error("init failed");
+      },
+      2
+    );
+
+    ok = false;
+  }
+  catch (std::runtime_error const&)
+  {
+  }
+
+  {
+    lua_State* const M(luaL_newstate());
+
+    luaL_openlibs(M);
+
+    for (auto const S: {L, M})
+    {
+      lualite::module{S, lualite::channel_class()};
+    }
+
+    ok = check(L,
+      "local ch = channel.new(\"checks\", 4)\n"
+      "assert(ch:capacity() == 4)\n"
+      "assert(ch:send({n = 1, s = \"one\"}))\n"
+      "assert(ch:send_many({2, 3, 4, 5}) == 3)\n"
+      "assert(not ch:send(6))\n"
+    ) && check(M,
+      "local ch = channel.new(\"checks\", 4)\n"
+      "local t = ch:recv()\n"
+      "assert(t.n == 1 and t.s == \"one\")\n"
+      "local r = ch:recv_many(8)\n"
+      "assert(#r == 3 and r[1] == 2 and r[3] == 4)\n"
+      "assert(ch:recv() == nil)\n"
+    ) && ok;
+
+    lua_close(M);
+
+    lualite::channel::close("checks");
+  }
+
+  {
+    std::string b;
+
+    luaL_dostring(L,
+      "local t = {1, 2, nil, 4, s = \"str\", [2.5] = true, n = {x = -3}}\n"
+      "t.self = t\n"
+      "t.same = t.n\n"
+      "return t"
+    );
+    lualite::serialize(L, -1, b);
+    lua_pop(L, 1);
+
+    ok = (b.size() == lualite::deserialize(L, b.data(), b.size())) && ok;
+    lua_setglobal(L, "copy");
+
+    ok = check(L,
+      "assert(copy[1] == 1 and copy[3] == nil and copy[4] == 4)\n"
+      "assert(copy.s == \"str\" and copy[2.5] and copy.n.x == -3)\n"
+      "assert(copy.self == copy and copy.same == copy.n)\n"
+    ) && ok;
+
+    // a nan key is malformed
+    b.clear();
+    luaL_dostring(L, "return {[0.5] = 1}");
+    lualite::serialize(L, -1, b);
+    lua_pop(L, 1);
+
+    lua_Number const h(.5), nan(std::numeric_limits<lua_Number>::quiet_NaN());
+
+    for (std::size_t i{}; i + sizeof(h) <= b.size(); ++i)
+    {
+      if (!std::memcmp(&b[i], &h, sizeof(h)))
+      {
+        std::memcpy(&b[i], &nan, sizeof(nan));
+      }
+      // else do nothing
+    }
+
+    try
+    {
+      lualite::deserialize(L, b.data(), b.size());
+
+      ok = false;
+    }
+    catch (lualite::error const&)
+    {
+    }
+
+    ok = !lua_gettop(L) && ok;
+  }
+
+  lualite::module(L).def<LLFUNC(get_points)>("points");
+
+  ok = check(L,
+    "local ps = points()\n"
+    "assert(#ps == 3 and ps[0] == nil and ps[4] == nil)\n"
+    "local a, b = ps[1], ps[2]\n"
+    "assert(rawequal(a, ps[1]) and not rawequal(a, b))\n"
+    "a.x = b.x\n"
+    "ps[3].y = ps[2].y + ps[1].y\n"
+    "assert(a.x == 3 and b.x == 3 and ps[3].y == 6)\n"
+    "ps:set(1, \"y\", ps:get(3, \"x\"))\n"
+    "assert(ps[1].y == 5 and not pcall(ps.get, ps, 4, \"x\"))\n"
+    "ps:add(\"x\", 1)\n"
+    "ps:mul(\"y\", 2)\n"
+    "assert(not pcall(ps.mul, ps, \"y\", 1.5))\n"
+    "local xs = ps:read(\"x\")\n"
+    "assert(#xs == 3 and xs[1] == 4 and xs[3] == 6)\n"
+    "ps:write(\"x\", {7, nil, 9})\n"
+    "assert(ps[1].x == 7 and ps[2].x == 4 and ps[3].x == 9)\n"
+  ) && (10 == points[0].y) && (12 == points[2].y) && ok;
+
+  {
+    lualite::module{L,
+      lualite::class_<pooled>("pooled")
+        .constructor<int>()
+        .def<LLFUNC(pooled::value)>("value")
+        .pool(2)
+    };
+
+    using pool = lualite::object_pool<pooled>;
+
+    // 3 misses, the cap keeps 2 of the collected blocks
+    ok = check(L,
+      "local t = {}\n"
+      "for i = 1, 3 do t[i] = pooled.new(i) end\n"
+      "assert(t[3]:value() == 3)\n"
+      "t = nil\n"
+      "collectgarbage()\n"
+    ) && !pool::stats().hits && (3 == pool::stats().misses) &&
+      (2 == pool::stats().size) && ok;
+
+    ok = check(L,
+      "a, b = pooled.new(4), pooled.new(5)\n"
+      "assert(a:value() + b:value() == 9)\n"
+    ) && (2 == pool::stats().hits) && !pool::stats().size && ok;
+
+    // a throwing constructor returns its block
+    ok = check(L, "assert(not pcall(pooled.new, -1))") &&
+      (4 == pool::stats().misses) && (1 == pool::stats().size) && ok;
+
+    ok = check(L, "a, b = nil collectgarbage()") &&
+      (2 == pool::stats().size) && !pooled::live && ok;
+
+    pool::trim();
+
+    ok = !pool::stats().size && ok;
+  }
+
+  {
+    lualite::module{L,
+      lualite::class_<counted>("counted")
+        .constructor()
+        .def<LLFUNC(counted::value)>("value")
+        .def<LLFUNC(counted::self)>("self")
+        .def<LLFUNC(counted::same)>("same")
+    };
+
+    {
+      lualite::arena_scope const outer(L);
+
+      ok = check(L,
+        "kept = counted.new()\n"
+        "pointed, referred, value = kept:self(), kept:same(), kept.value\n"
+        "assert(pointed:value() == 7 and referred:value() == 7)\n"
+      ) && (1 == outer.size()) && ok;
+
+      {
+        lualite::arena_scope const inner(L);
+
+        ok = check(L, "for i = 1, 3 do counted.new() end") &&
+          (3 == inner.size()) && (1 == outer.size()) &&
+          (4 == counted::live) && ok;
+      }
+
+      // the inner scope destroyed its instances only
+      ok = (1 == counted::live) && check(L,
+        "assert(kept:value() == 7)\n"
+        "counted.new()\n"
+      ) && (2 == outer.size()) && ok;
+    }
+
+    // ended objects, wrappers pushed later and fetched methods raise
+    // errors, new ones are collected as usual
+    ok = !counted::live && check(L,
+      "assert(not pcall(function() return kept:value() end))\n"
+      "assert(not pcall(function() kept.x = 1 end))\n"
+      "assert(not pcall(function() return pointed:value() end))\n"
+      "assert(not pcall(function() return referred:value() end))\n"
+      "local ok, e = pcall(value, kept)\n"
+      "assert(not ok and e:find(\"arena_scope\"))\n"
+      "pointed, referred, value = nil\n"
+      "assert(counted.new():value() == 7)\n"
+      "kept = nil\n"
+      "collectgarbage()\n"
+    ) && !counted::live && ok;
+  }
+
+  lualite::module(L)
+    .def<LLFUNC(get_numbers)>("numbers")
+    .def<LLFUNC(get_ages)>("ages")
+    .def<LLFUNC(count_to)>("count_to");
+
+  // the iterators ignore their arguments
+  ok = check(L,
+    "local s = 0\n"
+    "for i in numbers() do s = s + i end\n"
+    "assert(s == 6)\n"
+    "local t = {}\n"
+    "for k, v in ages() do t[k] = v end\n"
+    "assert(t.a == 1 and t.b == 2)\n"
+    "s = 0\n"
+    "for i in count_to(4) do s = s + i if i == 3 then break end end\n"
+    "assert(s == 6)\n"
+    "local f = numbers()\n"
+    "assert(f(1, 2) == 1 and f() == 2 and f(\"x\") == 3 and f() == nil)\n"
+  ) && ok;
+
+  {
+    lualite::module{L,
+      lualite::class_<enemy>("enemy")
+        .def<LLFUNC(enemy::health)>("health")
+    }
+    .def<LLFUNC(find_boss)>("find_boss");
+
+    {
+      enemy e;
+
+      boss = e.handle;
+
+      ok = check(L,
+        "e = find_boss()\n"
+        "assert(e:health() == 10)\n"
+      ) && ok;
+    }
+
+    // copies of the handle, in C++ and in lua, are detached with the enemy
+    ok = !boss && check(L,
+      "assert(not pcall(e.health, e))\n"
+      "assert(find_boss() == nil)\n"
+      "e = nil\n"
+    ) && ok;
+
+    // the slot is recycled, under a new generation
+    enemy f;
+
+    ok = (f.handle.slot() == boss.slot()) &&
+      (f.handle.generation() != boss.generation()) && !boss && ok;
+  }
+
+  lualite::module{L,
+    lualite::class_<fragile>("fragile")
+      .constructor()
+      .array_constructor()
+      .property<LLFUNC(fragile::get_i), LLFUNC(fragile::set_i)>("i")
+      .def<LLFUNC(fragile::twice)>("twice")
+  };
+
+  // elements have the methods and properties of the class, indices out of
+  // range find nothing
+  ok = check(L,
+    "local ps = fragile.new_array(3)\n"
+    "assert(#ps == 3 and ps[0] == nil and ps[4] == nil and ps.nope == nil)\n"
+    "ps[2].i = 4\n"
+    "assert(ps[2].i == 4 and ps[2]:twice() == 8 and ps:get(2, \"i\") == 4)\n"
+    "ps:set(3, \"i\", 5)\n"
+    "assert(ps[3]:twice() == 10 and ps:get(1, \"nope\") == nil)\n"
+    "assert(not pcall(ps.get, ps, 4, \"i\"))\n"
+    "assert(not pcall(ps.set, ps, 0, \"i\", 1))\n"
+    "assert(#fragile.new_array(0) == 0)\n"
+    "ps = nil\n"
+    "collectgarbage()\n"
+  ) && !fragile::live && ok;
+
+  // a throwing constructor leaves the constructed prefix to be destroyed
+  fragile::budget = 2;
+
+  ok = check(L, "assert(not pcall(fragile.new_array, 5))") &&
+    (2 == fragile::live) && check(L, "collectgarbage()") &&
+    !fragile::live && ok;
+
+  lualite::module{L,
+    lualite::class_<vec>("vec")
+      .constructor()
+      .property<LLFUNC(vec::x), LLFUNC(vec::set_x)>("x")
+      .property<LLFUNC(vec::y), LLFUNC(vec::set_y)>("y")
+      .property<LLFUNC(vec::sum)>("sum")
+      .batch()
+  };
+
+  lualite::set(L, lualite::accessor_plan<vec>{"x", "sum", "nope"});
+  lua_setglobal(L, "plan");
+
+  // unknown and read-only properties read as nil and ignore writes
+  ok = check(L,
+    "local v = vec.new()\n"
+    "v:set{x = 1, y = 2, sum = 9, nope = 4, [1] = 5}\n"
+    "assert(v.x == 1 and v.y == 2 and v.sum == 3)\n"
+    "local x, y, s, n, i = v:get(\"x\", \"y\", \"sum\", \"nope\", 1)\n"
+    "assert(x == 1 and y == 2 and s == 3 and n == nil and i == nil)\n"
+    "assert(select(\"#\", v:get()) == 0)\n"
+    "local a, b, c = plan(v)\n"
+    "assert(a == 1 and b == 3 and c == nil)\n"
+    "plan(v, 5, 9, 9)\n"
+    "assert(v.x == 5 and v.y == 2 and v.sum == 7)\n"
+    "assert(not pcall(plan, {}) and not pcall(plan, v, 1))\n"
+    "assert(not pcall(v.set, v, 1))\n"
+  ) && ok;
+
+#if (__cplusplus >= 201703L) && (LUA_VERSION_NUM >= 504)
+  {
+    lualite::scratch s(L, 1024);
+
+    lualite::module(L)
+      .def<LLFUNC(scratched)>("scratched")
+      .def<LLFUNC(copied)>("copied")
+      .def<LLFUNC(nested)>("nested")
+      .def<LLFUNC(thrown)>("thrown");
+
+    // only const reference arguments use the scratch, which is released by
+    // nested and failing calls alike
+    ok = check(L,
+      "assert(scratched(\"s\") and not copied(\"s\"))\n"
+      "assert(nested({\"a\", \"b\"}, function()\n"
+      "  return nested({\"c\", \"b\"}, function() return true end)\n"
+      "end))\n"
+      "assert(not nested({\"a\", \"b\"}, function() return false end))\n"
+      "local ok, e = pcall(nested, {\"a\"}, function() error(\"cb\") end)\n"
+      "assert(not ok and e:find(\"cb\"))\n"
+      "ok, e = pcall(thrown, \"thrown\")\n"
+      "assert(not ok and e:find(\"thrown\"))\n"
+      "assert(scratched(string.rep(\"s\", 4096)))\n"
+    ) && (std::pmr::get_default_resource() ==
+      lualite::scratch::resource(L)) && ok;
+  }
+#endif // __cplusplus, LUA_VERSION_NUM
+
+  lualite::module{L, "outer",
+    lualite::scope("inner",
+      lualite::scope("deep").enum_("d", 3)
+    )
+      .enum_("i", 1)
+      .def<LLFUNC(half)>("half"),
+    lualite::scope("other",
+      lualite::scope("leaf").enum_("l", 4)
+    )
+      .enum_("o", 2)
+  }
+  .enum_("m", 0);
+
+  // every member of a nested scope lands in the same table
+  ok = check(L,
+    "assert(outer.m == 0 and outer.inner.i == 1 and outer.other.o == 2)\n"
+    "assert(outer.inner.deep.d == 3 and outer.other.leaf.l == 4)\n"
+    "assert(outer.inner.half(4) == 2 and not outer.inner.leaf)\n"
+  ) && ok;
+
+  lualite::module{L, lualite::described_class<extent>("extent")};
+
+  lualite::set(L, lualite::accessor_plan<extent>{"total", "x", "nope"});
+  lua_setglobal(L, "extent_plan");
+
+  {
+    auto const& v(lualite::described_property_index<extent>());
+
+    ok = (3 == v.size()) && !std::strcmp("total", v[0]->name) &&
+      !std::strcmp("x", v[1]->name) && !std::strcmp("y", v[2]->name) && ok;
+  }
+
+  // described properties are found by name, read-only and unknown ones
+  // ignore writes
+  ok = check(L,
+    "assert(extent.dims == 2 and extent.kind == \"extent\")\n"
+    "local p = extent.make(1, 2)\n"
+    "assert(p.x == 1 and p.y == 2 and p.total == 3 and p:sum() == 3)\n"
+    "p.y, p.total, p.nope = 5, 9, 9\n"
+    "assert(p.y == 5 and p.total == 6 and p.nope == nil)\n"
+    "assert(p.new == nil and extent.new().x == 0)\n"
+    "local x, y, t = p:get(\"x\", \"y\", \"total\")\n"
+    "assert(x == 1 and y == 5 and t == 6)\n"
+    "local a, b, c = extent_plan(p)\n"
+    "assert(a == 6 and b == 1 and c == nil)\n"
+  ) && ok;
+
+  lualite::preload(L, "halving", init_halving);
+  lualite::preload(L, "failing", init_failing);
+
+  // init runs once, binds into the table require() returns and leaves the
+  // globals alone, even when it fails
+  ok = check(L,
+    "local h = require(\"halving\")\n"
+    "assert(h.halve(4) == 2 and h.kind == \"halving\")\n"
+    "assert(not halve and not kind and not getmetatable(h))\n"
+    "assert(require(\"halving\") == h)\n"
+    "local ok, e = pcall(require, \"failing\")\n"
+    "assert(not ok and e:find(\"init\") and string.rep)\n"
+  ) && (1 == inits) && ok;
+
+#if defined(__unix__) || defined(__APPLE__)
+  {
+    char d[]{"/tmp/lualiteXXXXXX"};
+
+    if (::mkdtemp(d))
+    {
+      lualite::bytecode_cache const c(d);
+
+      // a miss writes the file, a hit leaves it alone
+      ok = (1 == cached_run(c, L, "return 1")) && ok;
+
+      auto const f(files(d));
+
+      ok = (1 == f.size()) && (1 == cached_run(c, L, "return 1")) &&
+        (f == files(d)) && ok;
+
+      // changed sources miss
+      ok = (2 == cached_run(c, L, "return 2")) && (2 == files(d).size()) &&
+        ok;
+
+      // damaged files are compiled and written again
+      auto const& file(f.begin()->first);
+
+      ok = !::truncate(file.c_str(), 24) &&
+        (1 == cached_run(c, L, "return 1")) && (f != files(d)) &&
+        (f.begin()->second.second == files(d)[file].second) && ok;
+
+      auto const g(files(d));
+
+      if (auto const h = std::fopen(file.c_str(), "r+b"))
+      {
+        std::fseek(h, -1, SEEK_END);
+
+        auto const b(std::fgetc(h));
+
+        std::fseek(h, -1, SEEK_END);
+        std::fputc(0xff ^ b, h);
+        std::fclose(h);
+      }
+      // else do nothing
+
+      ok = (1 == cached_run(c, L, "return 1")) && (g != files(d)) && ok;
+
+      for (auto& e: files(d))
+      {
+        std::remove(e.first.c_str());
+      }
+
+      ::rmdir(d);
+    }
+    else
+    {
+      ok = false;
+    }
+  }
+#endif // __unix__ || __APPLE__
+
+  {
+    lua_State* const M(luaL_newstate());
+
+    luaL_openlibs(M);
+
+    for (auto const S: {L, M})
+    {
+      lualite::module{S,
+        lualite::class_<record>("record")
+          .property<LLFUNC(record::get_n)>("n")
+      }
+      .def<LLFUNC(get_shared_numbers)>("shared_numbers")
+      .def<LLFUNC(get_shared_index)>("shared_index")
+      .def<LLFUNC(get_shared_names)>("shared_names")
+      .def<LLFUNC(get_shared_small)>("shared_small")
+      .def<LLFUNC(get_shared_records)>("shared_records");
+    }
+
+    ok = check(L,
+      "local v = shared_numbers()\n"
+      "assert(#v == 3 and v[1] == 1 and v[3] == 3)\n"
+      "assert(v[0] == nil and v[4] == nil and v[1.5] == nil and v.x == nil)\n"
+      "local s = 0\n"
+      "for i, x in pairs(v) do s = s + i * x end\n"
+      "assert(s == 14)\n"
+      "local ok, e = pcall(function() v[1] = 2 end)\n"
+      "assert(not ok and e:find(\"shared\"))\n"
+      "local m = shared_index()\n"
+      "assert(#m == 1 and #m.a == 2 and m.a[2] == 2)\n"
+      "assert(m.b == nil and m[1] == nil)\n"
+      "for k, x in pairs(m) do assert(k == \"a\" and x[1] == 1) end\n"
+      "local n = shared_names()\n"
+      "assert(#n == 2 and n.x and n.y and n.z == nil and n[1] == nil)\n"
+      "local t = {}\n"
+      "for k, x in pairs(n) do t[k] = x end\n"
+      "assert(t.x and t.y)\n"
+      "local c = shared_small()\n"
+      "assert(c[1] == 10 and c[300] == nil and c[-200] == nil)\n"
+      "assert(c[1.5] == nil and c[\"1\"] == nil)\n"
+      "local r = shared_records()\n"
+      "assert(r[1].n == 5 and r[1].nope == nil)\n"
+      "assert(not pcall(function() r[1].n = 1 end))\n"
+    ) && check(M,
+      "assert(shared_numbers()[2] == 2 and shared_records()[1].n == 5)"
+    ) && ok;
+
+    lua_close(M);
+  }
+
+  // stubs are only named, once asked to
+  lua_rawgetp(L, LUA_REGISTRYINDEX, lualite::stub_names_key());
+
+  ok = lua_isnil(L, -1) && ok;
+
+  lua_pop(L, 1);
+
+  lualite::profiler::name_stubs(L);
+
+  lualite::module(L)
+    .def<LLFUNC(spin)>("spin")
+    .async_def<LLFUNC(later)>("later");
+
+  lua_rawgetp(L, LUA_REGISTRYINDEX, lualite::stub_names_key());
+  lua_getglobal(L, "later");
+  lua_pushcfunction(L, lua_tocfunction(L, -1));
+  lua_rawget(L, -3);
+
+  ok = lua_isstring(L, -1) && !std::strcmp(lua_tostring(L, -1), "later") &&
+    ok;
+
+  lua_pop(L, 3);
+
+  lua_sethook(L, hook, LUA_MASKLINE, 0);
+
+  {
+    // the stubs were named, before the profiler was attached, calls through
+    // other names are sampled under the bound one
+    lualite::profiler p(L, std::chrono::microseconds(10), 100);
+
+    ok = check(L, "local f = spin for i = 1, 100 do f() end") && ok;
+
+    auto const& s(p.samples());
+
+    ok = std::any_of(s.begin(), s.end(), [](auto const& i) {
+        auto const& k(i.first);
+
+        return (k.size() > 5) && !k.compare(k.size() - 5, 5, ";spin");
+      }
+    ) && ok;
+
+    // other states call the hook, but are not sampled
+    auto const S(luaL_newstate());
+
+    lualite::module(S).def<LLFUNC(spin)>("spin");
+
+    p.clear();
+
+    ok = check(S, "for i = 1, 100 do spin() end") && p.samples().empty() &&
+      ok;
+
+    lua_close(S);
+  }
+
+  // the previous hook is restored
+  ok = (hook == lua_gethook(L)) && (LUA_MASKLINE == lua_gethookmask(L)) &&
+    ok;
+
+  lua_sethook(L, nullptr, 0, 0);
+
   lua_close(L);
 
-  return EXIT_SUCCESS;
+  if (ok)
+  {
+    return EXIT_SUCCESS;
+  }
+  else
+  {
+    std::cerr << "checks failed" << std::endl;
+
+    return EXIT_FAILURE;
+  }
 }